@@ -27,73 +27,15 @@
 #ifndef AS_BH1750_h
 #define AS_BH1750_h
 
-#if (ARDUINO >= 100)
-#include <Arduino.h>
-#else
-#include <WProgram.h>
-#endif
-#include "Wire.h"
-
-// Possible I2C addresses
-#define BH1750_DEFAULT_I2CADDR 0x23
-#define BH1750_SECOND_I2CADDR 0x5C
-
-// MTreg values
-// Default
-#define BH1750_MTREG_DEFAULT 69
-// Sensitivity : default = 0.45
-#define BH1750_MTREG_MIN 31
-// Sensitivity : default = 3.68
-#define BH1750_MTREG_MAX 254
-
-// Hardware Modes
-// No active state
-#define BH1750_POWER_DOWN 0x00
-
-// Wating for measurment command
-#define BH1750_POWER_ON 0x01
-
-// Reset data register value - not accepted in POWER_DOWN mode
-#define BH1750_RESET 0x07
-
-// Start measurement at 1lx resolution. Measurement time is approx 120ms.
-#define BH1750_CONTINUOUS_HIGH_RES_MODE  0x10
-
-// Start measurement at 0.5lx resolution. Measurement time is approx 120ms.
-#define BH1750_CONTINUOUS_HIGH_RES_MODE_2  0x11
-
-// Start measurement at 4lx resolution. Measurement time is approx 16ms.
-#define BH1750_CONTINUOUS_LOW_RES_MODE  0x13
-
-// Start measurement at 1lx resolution. Measurement time is approx 120ms.
-// Device is automatically set to Power Down after measurement.
-#define BH1750_ONE_TIME_HIGH_RES_MODE  0x20
-
-// Start measurement at 0.5lx resolution. Measurement time is approx 120ms.
-// Device is automatically set to Power Down after measurement.
-#define BH1750_ONE_TIME_HIGH_RES_MODE_2  0x21
-
-// Start measurement at 1lx resolution. Measurement time is approx 120ms.
-// Device is automatically set to Power Down after measurement.
-#define BH1750_ONE_TIME_LOW_RES_MODE  0x23
-
-/** Virtual Modes */
-typedef enum
-{
-  RESOLUTION_LOW         = (1), /** 4lx resolution. Measurement time is approx 16ms. */  
-  RESOLUTION_NORMAL      = (2), /** 1lx resolution. Measurement time is approx 120ms. */
-  RESOLUTION_HIGH        = (3), /** 0,5lx resolution. Measurement time is approx 120ms. */
-  RESOLUTION_AUTO_HIGH   = (99) /** 0,11-1lx resolution. Measurement time is above 250ms. */
-  }  
-  sensors_resolution_t;
-
-typedef void (*DelayFuncPtr)(unsigned long);
-typedef unsigned long (*TimeFuncPtr)(void);
+#include "AS_BH1750Core.h"
 
 /**
  * BH1750 driver class.
+ * Blocking measurement: readLightLevel() waits with the given delay function
+ * until the measurement is finished. Initialization, power handling, flicker detection,
+ * capture and saved state are provided by the common core (see AS_BH1750Core.h).
  */
-class AS_BH1750 {
+class AS_BH1750 : public AS_BH1750Core {
 public:
   /**
    * Constructor.
@@ -106,79 +48,51 @@ public:
   AS_BH1750(uint8_t address = BH1750_DEFAULT_I2CADDR);
 
   /**
-   * Performs the first initialization of the sensor.
+   * Returns current measured value for brightness in lux (lx).
+   * If the sensor is in low-power mode, it is automatically awakened.
+   *
+   * If the sensor has not (yet) been initialized (begin), the value -1 is supplied.
+   * On a bus error -1, on a bus timeout BH1750_TIMEOUT (see setBusTimeout),
+   * -1 while the circuit is open (also after timeouts, see setFailureThreshold).
+   *
    * Possible parameters:
-   * - Sensor resolution mode:
-   * - RESOLUTION_LOW: Physical sensor mode with 4 lx resolution. Measurement time approx. 16ms. Range 0-54612.
-   * - RESOLUTION_NORMAL: Physical sensor mode with 1 lx resolution. Measurement time approx. 120ms. Range 0-54612.
-   * - RESOLUTION_HIGH: Physical sensor mode with 0.5 lx resolution. Measurement time approx. 120ms. Range 0-54612.
-   * (The measuring ranges can be moved by changing the MTreg.)
-   * - RESOLUTION_AUTO_HIGH: The values in the MTreg are automatically adjusted according to the brightness,
-   * that a maximum resolution and measuring range are achieved.
-   * The measurable values range from 0.11 lx to 100,000 lx.
-   * (I do not know how accurate the values are in border areas,
-   * especially with high values I have my doubts.
-   * However, the values seem to grow largely linearly with the increasing brightness.)
-   * Resolution in the lower range approximately 0.13 lx, in the middle 0.5 lx, in the upper approximately 1-2 lx.
-   * The measurement times are extended by multiple measurements and measurements
-   * the changes from Measurement Time (MTreg) to max. approx. 500 ms.
    *
-   * - AutoPowerDown: true = The sensor is placed in the power saving mode after the measurement.
-   * The subsequent wake-up is performed automatically, but takes slightly more time.
+   * - DelayFuncPtr: delay (n) Ability to add your own delay function (e.g., to use sleep mode).
    *
-   * Default values: RESOLUTION_AUTO_HIGH, true, delay()
+   * Default values: delay ()
    *
    */
-  bool begin(sensors_resolution_t mode = RESOLUTION_AUTO_HIGH, bool autoPowerDown = true);
+  float readLightLevel(DelayFuncPtr fDelayPtr = &delay);
 
   /**
-   * Allow a check to see if a (responsive) BH1750 sensor is present.
+   * Measurement with its context: raw value, MTreg, hardware mode, lux, status flags
+   * (BH1750_MEASUREMENT_...) and the integration interval (start and end in ms of the time function).
+   * Filters can work on the raw value and its scale without converting the lux value back.
+   * Returns true if the measurement is valid.
+   *
+   * Default values: delay (), millis ()
    */
-  bool isPresent(void);
+  bool readMeasurement(bh1750_measurement_t* m, DelayFuncPtr fDelayPtr = &delay, TimeFuncPtr fTimePtr = &millis);
 
   /**
-   * Returns current measured value for brightness in lux (lx).
-   * If the sensor is in low-power mode, it is automatically awakened.
-   *
-   * If the sensor has not (yet) been initialized (begin), the value -1 is supplied.
-   *
-   * Possible parameters:
-   *
-   * - DelayFuncPtr: delay (n) Ability to add your own delay function (e.g., to use sleep mode).
-   *
-   * Default values: delay ()
+   * Like readLightLevel, in RESOLUTION_AUTO_HIGH with an early estimate: as soon as the probe
+   * (L-resolution, approx. 16 ms after the start) is read, its light level (4 lx resolution)
+   * is passed to fEstimatePtr, e.g. for a control loop reacting to large changes.
+   * The return value is the refined result of the actual measurement.
+   * Other modes have no probe, fEstimatePtr is not called.
    *
+   * Default values: delay ()
    */
-  float readLightLevel(DelayFuncPtr fDelayPtr = &delay);
+  float readLightLevelProgressive(EstimateFuncPtr fEstimatePtr, DelayFuncPtr fDelayPtr = &delay);
 
   /**
-   * Sends the sensor to power saving mode.
-   * Only works if the sensor has already been initialized.
+   * Measurement without conversion: raw value with MTreg and hardware mode,
+   * e.g. for logging. Lux: bh1750Lux() or convertBatch() (AS_BH1750Batch.h), also later on a host.
+   * Returns false if not initialized or on a bus error.
+   *
+   * Default values: delay ()
    */
-  void powerDown(void);
-
-private:
-  int _address;
-  uint8_t _hardwareMode;
-
-  uint8_t _MTreg;
-  float _MTregFactor;
-
-  sensors_resolution_t _virtualMode;
-  bool _autoPowerDown;
-
-  bool _valueReaded;
-
-  bool selectResolutionMode(uint8_t mode, DelayFuncPtr fDelayPtr = &delay);
-  void defineMTReg(uint8_t val);
-  void powerOn(void);
-  void reset(void);
-  uint16_t readRawLevel(void);
-  float convertRawValue(uint16_t raw);
-  bool isInitialized();
-  bool write8(uint8_t data);
+  bool readRaw(bh1750_record_t* r, DelayFuncPtr fDelayPtr = &delay);
 };
 
 #endif
-
-
@@ -27,75 +27,15 @@
 #ifndef AS_BH1750A_h
 #define AS_BH1750A_h
 
-#if (ARDUINO >= 100)
-#include <Arduino.h>
-#else
-#include <WProgram.h>
-#endif
-#include "Wire.h"
-
-// Mögliche I2C Adressen
-#define BH1750_DEFAULT_I2CADDR 0x23
-#define BH1750_SECOND_I2CADDR 0x5C
-
-// MTreg Werte
-// Default
-#define BH1750_MTREG_DEFAULT 69
-// Sensitivity : default = 0.45
-#define BH1750_MTREG_MIN 31
-// Sensitivity : default = 3.68
-#define BH1750_MTREG_MAX 254
-
-// Hardware Modi
-// No active state
-#define BH1750_POWER_DOWN 0x00
-
-// Wating for measurment command
-#define BH1750_POWER_ON 0x01
-
-// Reset data register value - not accepted in POWER_DOWN mode
-#define BH1750_RESET 0x07
-
-// Start measurement at 1lx resolution. Measurement time is approx 120ms.
-#define BH1750_CONTINUOUS_HIGH_RES_MODE  0x10
-
-// Start measurement at 0.5lx resolution. Measurement time is approx 120ms.
-#define BH1750_CONTINUOUS_HIGH_RES_MODE_2  0x11
-
-// Start measurement at 4lx resolution. Measurement time is approx 16ms.
-#define BH1750_CONTINUOUS_LOW_RES_MODE  0x13
-
-// Start measurement at 1lx resolution. Measurement time is approx 120ms.
-// Device is automatically set to Power Down after measurement.
-#define BH1750_ONE_TIME_HIGH_RES_MODE  0x20
-
-// Start measurement at 0.5lx resolution. Measurement time is approx 120ms.
-// Device is automatically set to Power Down after measurement.
-#define BH1750_ONE_TIME_HIGH_RES_MODE_2  0x21
-
-// Start measurement at 1lx resolution. Measurement time is approx 120ms.
-// Device is automatically set to Power Down after measurement.
-#define BH1750_ONE_TIME_LOW_RES_MODE  0x23
-
-#define MAX_U_LONG 4294967295;
-
-/** Virtual Modi */
-typedef enum
-{
-  RESOLUTION_LOW         = (1), /** 4lx resolution. Measurement time is approx 16ms. */  
-  RESOLUTION_NORMAL      = (2), /** 1lx resolution. Measurement time is approx 120ms. */
-  RESOLUTION_HIGH        = (3), /** 0,5lx resolution. Measurement time is approx 120ms. */
-  RESOLUTION_AUTO_HIGH   = (99) /** 0,11-1lx resolution. Measurement time is above 250ms. */
-  }  
-  sensors_resolution_t;
-
-typedef void (*DelayFuncPtr)(unsigned long);
-typedef unsigned long (*TimeFuncPtr)(void);
+#include "AS_BH1750Core.h"
 
 /**
- * BH1750 driver class.
+ * BH1750 driver class (asynchron).
+ * Die Messung läuft als Stufenmaschine des gemeinsamen Kerns (AS_BH1750Core) ab,
+ * der Aufrufer wird zwischen den Stufen nicht blockiert.
+ * Initialisierung (begin), isPresent, powerDown usw. stammen aus dem Kern.
  */
-class AS_BH1750A {
+class AS_BH1750A : public AS_BH1750Core {
 public:
   /**
    * Constructor.
@@ -107,36 +47,6 @@ public:
    */
   AS_BH1750A(uint8_t address = BH1750_DEFAULT_I2CADDR);
 
-  /**
-   * Führt die anfängliche Initialisierung des Sensors.
-   * Mögliche Parameter: 
-   *  - Modus für die Sensorauflösung:
-   *    -- RESOLUTION_LOW:         Physische Sensormodus mit 4 lx Auflösung. Messzeit ca. 16ms. Bereich 0-54612.
-   *    -- RESOLUTION_NORMAL:      Physische Sensormodus mit 1 lx Auflösung. Messzeit ca. 120ms. Bereich 0-54612.
-   *    -- RESOLUTION_HIGH:        Physische Sensormodus mit 0,5 lx Auflösung. Messzeit ca. 120ms. Bereich 0-54612.
-   *                               (Die Messbereiche können durch Änderung des MTreg verschoben werden.)
-   *    -- RESOLUTION_AUTO_HIGH:   Die Werte im MTreg werden je nach Helligkeit automatisch so angepasst, 
-   *                               dass eine maximalmögliche Auflösung und Messbereich erziehlt werden.
-   *                               Die messbaren Werte fangen von 0,11 lx und gehen bis über 100000 lx.
-   *                               (ich weis nicht, wie genau die Werte in Grenzbereichen sind, 
-   *                               besonders bei hohen Werte habe ich meine Zweifel.)
-   *                               Auflösung im Unteren Bereich 0,13 lx, im mittleren 0,5 lx, im oberen 1-2 lx.
-   *                               Die Messzeiten verlängern sich durch mehrfache Messungen und 
-   *                               die Änderungen von Measurement Time (MTreg) bis max. ca. 500 ms.
-   *   
-   * - AutoPowerDown: true = Der Sensor wird nach der Messung in den Stromsparmodus versetzt. 
-   *   Das spätere Aufwecken wird ggf. automatisch vorgenommen, braucht jedoch geringfügig mehr Zeit.
-   *
-   * Defaultwerte: RESOLUTION_AUTO_HIGH, true, delay()
-   *
-   */
-  bool begin(sensors_resolution_t mode = RESOLUTION_AUTO_HIGH, bool autoPowerDown = true);
-
-  /**
-   * Erlaub eine Prüfung, ob ein (ansprechbarer) BH1750-Sensor vorhanden ist.
-   */
-  bool isPresent(void);
-
   /**
    * Liefert aktuell gemessenen Wert für Helligkeit in lux (lx).
    * Falls sich der Sensorf in Stromsparmodus befindet, wird er automatisch geweckt.
@@ -146,62 +56,63 @@ public:
    * Mögliche Parameter: 
    *
    * - DelayFuncPtr: delay(n) Möglichkeit, eigene Delay-Funktion mitzugeben (z.B. um sleep-Modus zu verwenden).
+   * - TimeFuncPtr: millis() oder eigene Zeitfunktion (ms).
    * 
-   * Defaultwerte: delay()
+   * Defaultwerte: delay(), millis()
    *
    */
   float readLightLevel(DelayFuncPtr fDelayPtr = &delay, TimeFuncPtr fTimePtr = &millis);
 
+  /**
+   * Startet eine Messung. Liefert false, wenn der Sensor nicht initialisiert ist.
+   */
   bool startMeasurementAsync(TimeFuncPtr fTimePtr = &millis);
+
+  /**
+   * Führt die nächste Stufe aus, sobald ihre Wartezeit abgelaufen ist.
+   * Liefert true, wenn die Messung abgeschlossen ist (oder keine läuft).
+   */
   bool isMeasurementReady(void);
+
+  /**
+   * Liefert das Ergebnis der Messung in lux,
+   * -100 solange die Messung läuft, BH1750_TIMEOUT bei Zeitüberschreitung auf dem Bus
+   * und -1 bei sonstigem Fehler (oder ohne gestartete Messung), auch bei offenem Stromkreis
+   * nach wiederholten Zeitüberschreitungen (siehe setFailureThreshold).
+   */
   float readLightLevelAsync();
-  
-  //float checkAndReadLightLevelAsync(TimeFuncPtr fTimePtr);
 
-  //void reset(void);
-  unsigned long nextDelay(void);
+  /**
+   * Liefert das Ergebnis der Messung mit Kontext: Rohwert, MTreg, Hardware-Modus, lux,
+   * Status-Flags (BH1750_MEASUREMENT_...) und Integrationszeitraum (Beginn und Ende in ms der Zeitfunktion).
+   * Liefert false, solange die Messung läuft (BH1750_MEASUREMENT_RUNNING).
+   * Im Modus RESOLUTION_AUTO_HIGH enthält m nach der Probe (ca. 16 ms) bereits deren Schätzwert
+   * (BH1750_MEASUREMENT_ESTIMATE, 4 lx Auflösung, Rohwert mit MTreg 69 und L-Resolution),
+   * bis die eigentliche Messung fertig ist.
+   */
+  bool readMeasurementAsync(bh1750_measurement_t* m);
 
   /**
-   * Schickt den Sensor in Stromsparmodus.
-   * Funktionier nur, wenn der Sensor bereits initialisiert wurde.
+   * Liefert das Ergebnis der Messung ohne Umrechnung: Rohwert mit MTreg und Hardware-Modus,
+   * z.B. zum Protokollieren. Lux: bh1750Lux() oder convertBatch() (AS_BH1750Batch.h), auch später auf einem Host.
+   * Liefert false, solange die Messung läuft, bei Fehler oder ohne gestartete Messung.
    */
-  void powerDown(void);
+  bool readRawAsync(bh1750_record_t* r);
 
-//bool delayExpired(); // TEST
+  /**
+   * Wartezeit der aktuellen Stufe (ms).
+   */
+  unsigned long nextDelay(void);
 
 private:
-  int _address;
-  uint8_t _hardwareMode;
-
-  uint8_t _MTreg;
-  float _MTregFactor;
-
-  sensors_resolution_t _virtualMode;
-  bool _autoPowerDown;
-
-  bool _valueReaded;
-
-  bool selectResolutionMode(uint8_t mode);
-  void defineMTReg(uint8_t val);
-  void powerOn();
-  //void reset(void);
-  uint16_t readRawLevel(void);
-  float convertRawValue(uint16_t raw);
-  bool isInitialized();
-  bool write8(uint8_t data);
-  
+  // Stufenmaschine (Sensorzustand: 7 Bytes im Kern)
   TimeFuncPtr _fTimePtr;
-  int _stage = 0;
-  int _nextDelay = 0;
-  int _lastTimestamp = 0;
-  float _lastResult = -100;
+  unsigned long _lastTimestamp;
+  unsigned long _startTimestamp; // Start der Wandlung des Ergebnisses (bzw. Zeitpunkt des Lesens)
+  bh1750_job_t _job;
+
   bool delayExpired();
-  void selectAutoMode();
-  
-  // TEST
-  //float readLightLevel_alt(DelayFuncPtr fDelayPtr = &delay);
-  unsigned long getModeDelay();
-  
+  bool nextStep(void);
 };
 
 #endif
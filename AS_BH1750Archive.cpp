@@ -0,0 +1,487 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Archive.h"
+
+#ifdef BH1750_HOST
+
+#include "AS_BH1750Batch.h"
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BH1750_ARCHIVE_INDEX(map, segment) ((bh1750_archive_index_t*)((map) + BH1750_ARCHIVE_PAGE + (size_t)(segment) * BH1750_ARCHIVE_SEGMENT_BYTES))
+
+/**
+ * Checks the header of an archive file of the given size.
+ */
+static bool archiveHeaderValid(const bh1750_archive_header_t& header, size_t size) {
+  return header.magic==BH1750_ARCHIVE_MAGIC && header.version==BH1750_ARCHIVE_VERSION
+    && header.recordsPerSegment==BH1750_ARCHIVE_RECORDS && header.segmentBytes==BH1750_ARCHIVE_SEGMENT_BYTES
+    && size>=BH1750_ARCHIVE_PAGE && (size-BH1750_ARCHIVE_PAGE) % BH1750_ARCHIVE_SEGMENT_BYTES==0;
+}
+
+BH1750ArchiveWriter::BH1750ArchiveWriter(void) {
+  _fd = -1;
+  _map = NULL;
+  _mapBytes = 0;
+  _segments = 0;
+}
+
+BH1750ArchiveWriter::~BH1750ArchiveWriter(void) {
+  close();
+}
+
+bool BH1750ArchiveWriter::open(const char* path, uint32_t sensor) {
+  close();
+  _fd = ::open(path, O_RDWR | O_CREAT, 0644);
+  if(_fd<0) {
+    return false;
+  }
+  struct stat st;
+  if(fstat(_fd, &st)!=0) {
+    close();
+    return false;
+  }
+  bh1750_archive_header_t header;
+  if(st.st_size==0) {
+    memset(&header, 0, sizeof(header));
+    header.magic = BH1750_ARCHIVE_MAGIC;
+    header.version = BH1750_ARCHIVE_VERSION;
+    header.sensor = sensor;
+    header.recordsPerSegment = BH1750_ARCHIVE_RECORDS;
+    header.segmentBytes = BH1750_ARCHIVE_SEGMENT_BYTES;
+    if(ftruncate(_fd, BH1750_ARCHIVE_PAGE)!=0 || pwrite(_fd, &header, sizeof(header), 0)!=(ssize_t)sizeof(header)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+  if(pread(_fd, &header, sizeof(header), 0)!=(ssize_t)sizeof(header)
+    || !archiveHeaderValid(header, st.st_size) || header.sensor!=sensor) {
+    close();
+    return false;
+  }
+  if(!mapSegments((st.st_size-BH1750_ARCHIVE_PAGE) / BH1750_ARCHIVE_SEGMENT_BYTES)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Maps the file with the given number of segments (extends the file if necessary).
+ */
+bool BH1750ArchiveWriter::mapSegments(uint32_t segments) {
+  if(_map) {
+    munmap(_map, _mapBytes);
+    _map = NULL;
+  }
+  size_t bytes = BH1750_ARCHIVE_PAGE + (size_t)segments * BH1750_ARCHIVE_SEGMENT_BYTES;
+  if(segments>_segments && ftruncate(_fd, bytes)!=0) {
+    return false;
+  }
+  void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if(map==MAP_FAILED) {
+    return false;
+  }
+  _map = (uint8_t*)map;
+  _mapBytes = bytes;
+  _segments = segments;
+  return true;
+}
+
+bool BH1750ArchiveWriter::append(uint64_t time, const bh1750_measurement_t& m) {
+  return store(time, m.raw, m.MTreg, m.mode, m.status);
+}
+
+bool BH1750ArchiveWriter::append(uint64_t time, const bh1750_record_t& r) {
+  uint8_t status = BH1750_MEASUREMENT_VALID;
+  if(r.raw==0xFFFF) {
+    status |= BH1750_MEASUREMENT_SATURATED;
+  }
+  return store(time, r.raw, r.MTreg, r.mode, status);
+}
+
+/**
+ * Writes the columns of the record and the summary first, then publishes the count (release).
+ */
+bool BH1750ArchiveWriter::store(uint64_t time, uint16_t raw, uint8_t mtreg, uint8_t mode, uint8_t status) {
+  if(_fd<0) {
+    return false;
+  }
+  if(_segments==0 || BH1750_ARCHIVE_INDEX(_map, _segments-1)->count>=BH1750_ARCHIVE_RECORDS) {
+    if(!mapSegments(_segments+1)) {
+      return false;
+    }
+  }
+  bh1750_archive_index_t* index = BH1750_ARCHIVE_INDEX(_map, _segments-1);
+  uint8_t* segment = (uint8_t*)index;
+  uint32_t i = index->count;
+  if(mtreg<BH1750_MTREG_MIN || mtreg>BH1750_MTREG_MAX) {
+    status &= ~BH1750_MEASUREMENT_VALID; // cannot be converted
+  }
+  ((uint64_t*)(segment + BH1750_ARCHIVE_TIME_OFFSET))[i] = time;
+  ((uint16_t*)(segment + BH1750_ARCHIVE_RAW_OFFSET))[i] = raw;
+  segment[BH1750_ARCHIVE_MTREG_OFFSET + i] = mtreg;
+  segment[BH1750_ARCHIVE_MODE_OFFSET + i] = mode;
+  segment[BH1750_ARCHIVE_STATUS_OFFSET + i] = status;
+
+  if(i==0 || time<index->timeMin) {
+    index->timeMin = time;
+  }
+  if(i==0 || time>index->timeMax) {
+    index->timeMax = time;
+  }
+  if(status&BH1750_MEASUREMENT_VALID) {
+    float lux = bh1750Lux(raw, mtreg, mode);
+    bool first = index->valid==0;
+    if(first || lux<index->luxMin) index->luxMin = lux;
+    if(first || lux>index->luxMax) index->luxMax = lux;
+    if(first || raw<index->rawMin) index->rawMin = raw;
+    if(first || raw>index->rawMax) index->rawMax = raw;
+    if(first || mtreg<index->MTregMin) index->MTregMin = mtreg;
+    if(first || mtreg>index->MTregMax) index->MTregMax = mtreg;
+    index->valid++;
+  }
+  __atomic_store_n(&index->count, i+1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool BH1750ArchiveWriter::flush(void) {
+  return _map==NULL || msync(_map, _mapBytes, MS_SYNC)==0;
+}
+
+void BH1750ArchiveWriter::close(void) {
+  if(_map) {
+    munmap(_map, _mapBytes);
+    _map = NULL;
+  }
+  if(_fd>=0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+  _mapBytes = 0;
+  _segments = 0;
+}
+
+uint64_t BH1750ArchiveWriter::count(void) {
+  if(_segments==0) {
+    return 0;
+  }
+  return (uint64_t)(_segments-1) * BH1750_ARCHIVE_RECORDS + BH1750_ARCHIVE_INDEX(_map, _segments-1)->count;
+}
+
+BH1750ArchiveReader::BH1750ArchiveReader(void) {
+  _fd = -1;
+  _map = NULL;
+  _mapBytes = 0;
+  _segments = 0;
+  _touched = 0;
+}
+
+BH1750ArchiveReader::~BH1750ArchiveReader(void) {
+  close();
+}
+
+bool BH1750ArchiveReader::open(const char* path) {
+  close();
+  _fd = ::open(path, O_RDONLY);
+  if(_fd<0) {
+    return false;
+  }
+  if(!remap()) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Maps the file again if it has grown since the last mapping (the writer appended segments).
+ * Returns false if the file is no (longer a) valid archive; the previous mapping then stays.
+ */
+bool BH1750ArchiveReader::remap(void) {
+  struct stat st;
+  if(fstat(_fd, &st)!=0 || (size_t)st.st_size<BH1750_ARCHIVE_PAGE) {
+    return false;
+  }
+  if(_map && (size_t)st.st_size==_mapBytes) {
+    return true;
+  }
+  // a segment being added can be visible with the header page only
+  size_t bytes = st.st_size - (st.st_size-BH1750_ARCHIVE_PAGE) % BH1750_ARCHIVE_SEGMENT_BYTES;
+  void* map = mmap(NULL, bytes, PROT_READ, MAP_SHARED, _fd, 0);
+  if(map==MAP_FAILED) {
+    return false;
+  }
+  if(!archiveHeaderValid(*(const bh1750_archive_header_t*)map, bytes)) {
+    munmap(map, bytes);
+    return false;
+  }
+  if(_map) {
+    munmap((void*)_map, _mapBytes);
+  }
+  _map = (const uint8_t*)map;
+  _mapBytes = bytes;
+  _segments = (bytes-BH1750_ARCHIVE_PAGE) / BH1750_ARCHIVE_SEGMENT_BYTES;
+  return true;
+}
+
+/**
+ * Number of completely written records of a segment (acquire, see BH1750ArchiveWriter::store).
+ */
+uint32_t BH1750ArchiveReader::published(const bh1750_archive_index_t* index) {
+  return __atomic_load_n(&index->count, __ATOMIC_ACQUIRE);
+}
+
+void BH1750ArchiveReader::close(void) {
+  if(_map) {
+    munmap((void*)_map, _mapBytes);
+    _map = NULL;
+  }
+  if(_fd>=0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+  _mapBytes = 0;
+  _segments = 0;
+}
+
+uint32_t BH1750ArchiveReader::sensor(void) {
+  return _map ? ((const bh1750_archive_header_t*)_map)->sensor : 0;
+}
+
+uint32_t BH1750ArchiveReader::segments(void) {
+  return _segments;
+}
+
+uint64_t BH1750ArchiveReader::count(void) {
+  uint64_t n = 0;
+  if(_fd>=0) {
+    remap();
+  }
+  for(uint32_t s=0; s<_segments; s++) {
+    n += published(index(s));
+  }
+  return n;
+}
+
+const bh1750_archive_index_t* BH1750ArchiveReader::index(uint32_t segment) {
+  return BH1750_ARCHIVE_INDEX(_map, segment);
+}
+
+/**
+ * Segments lying completely in the range are converted as a whole (convertBatchSoA),
+ * the others record by record.
+ */
+size_t BH1750ArchiveReader::query(uint64_t from, uint64_t to, uint64_t* time, float* lux, size_t size) {
+  size_t n = 0;
+  _touched = 0;
+  if(_fd>=0) {
+    remap();
+  }
+  for(uint32_t s=0; s<_segments && n<size; s++) {
+    const bh1750_archive_index_t* idx = index(s);
+    uint32_t count = published(idx);
+    if(count==0 || idx->valid==0 || idx->timeMax<from || idx->timeMin>to) {
+      continue;
+    }
+    _touched++;
+    const uint8_t* segment = (const uint8_t*)idx;
+    const uint64_t* times = (const uint64_t*)(segment + BH1750_ARCHIVE_TIME_OFFSET);
+    const uint16_t* raw = (const uint16_t*)(segment + BH1750_ARCHIVE_RAW_OFFSET);
+    const uint8_t* mtreg = segment + BH1750_ARCHIVE_MTREG_OFFSET;
+    const uint8_t* mode = segment + BH1750_ARCHIVE_MODE_OFFSET;
+    const uint8_t* status = segment + BH1750_ARCHIVE_STATUS_OFFSET;
+    if(idx->timeMin>=from && idx->timeMax<=to && count<=size-n) {
+      // completely in the range: convert the whole columns, then drop invalid records
+      memcpy(time+n, times, count * sizeof(uint64_t));
+      convertBatchSoA(raw, mtreg, mode, lux+n, count);
+      // the summary of a segment still being written may include an unpublished record
+      if(count==BH1750_ARCHIVE_RECORDS && idx->valid==count) {
+        n += count;
+        continue;
+      }
+      size_t w = n;
+      for(uint32_t i=0; i<count; i++) {
+        if(status[i]&BH1750_MEASUREMENT_VALID) {
+          time[w] = time[n+i];
+          lux[w] = lux[n+i];
+          w++;
+        }
+      }
+      n = w;
+      continue;
+    }
+    for(uint32_t i=0; i<count && n<size; i++) {
+      if(times[i]>=from && times[i]<=to && (status[i]&BH1750_MEASUREMENT_VALID)) {
+        time[n] = times[i];
+        lux[n] = bh1750Lux(raw[i], mtreg[i], mode[i]);
+        n++;
+      }
+    }
+  }
+  return n;
+}
+
+bool BH1750ArchiveReader::range(uint64_t from, uint64_t to, float* luxMin, float* luxMax) {
+  float lo = FLT_MAX;
+  float hi = -FLT_MAX;
+  _touched = 0;
+  if(_fd>=0) {
+    remap();
+  }
+  for(uint32_t s=0; s<_segments; s++) {
+    const bh1750_archive_index_t* idx = index(s);
+    uint32_t count = published(idx);
+    if(count==0 || idx->valid==0 || idx->timeMax<from || idx->timeMin>to) {
+      continue;
+    }
+    if(count==BH1750_ARCHIVE_RECORDS && idx->timeMin>=from && idx->timeMax<=to) {
+      if(idx->luxMin<lo) lo = idx->luxMin;
+      if(idx->luxMax>hi) hi = idx->luxMax;
+      continue;
+    }
+    _touched++;
+    const uint8_t* segment = (const uint8_t*)idx;
+    const uint64_t* times = (const uint64_t*)(segment + BH1750_ARCHIVE_TIME_OFFSET);
+    const uint16_t* raw = (const uint16_t*)(segment + BH1750_ARCHIVE_RAW_OFFSET);
+    const uint8_t* mtreg = segment + BH1750_ARCHIVE_MTREG_OFFSET;
+    const uint8_t* mode = segment + BH1750_ARCHIVE_MODE_OFFSET;
+    const uint8_t* status = segment + BH1750_ARCHIVE_STATUS_OFFSET;
+    for(uint32_t i=0; i<count; i++) {
+      if(times[i]>=from && times[i]<=to && (status[i]&BH1750_MEASUREMENT_VALID)) {
+        float lux = bh1750Lux(raw[i], mtreg[i], mode[i]);
+        if(lux<lo) lo = lux;
+        if(lux>hi) hi = lux;
+      }
+    }
+  }
+  if(lo>hi) {
+    return false;
+  }
+  *luxMin = lo;
+  *luxMax = hi;
+  return true;
+}
+
+uint32_t BH1750ArchiveReader::touched(void) {
+  return _touched;
+}
+
+// Time base of the benchmark (ms since the epoch) and interval of the measurements
+#define ARCHIVE_BENCH_START 1700000000000ULL
+#define ARCHIVE_BENCH_INTERVAL 1000ULL
+#define ARCHIVE_BENCH_DAY (86400ULL * 1000)
+#define ARCHIVE_BENCH_HOUR (3600ULL * 1000)
+
+/**
+ * Query throughput for windows of the given length at random positions.
+ */
+static void archiveQueryLine(FILE* out, BH1750ArchiveReader& reader, const char* name, uint64_t window, uint32_t records,
+  uint64_t* time, float* lux, size_t size, uint16_t queries, bool ranges) {
+  uint64_t span = (uint64_t)records * ARCHIVE_BENCH_INTERVAL;
+  uint32_t x = 0x6C078965UL;
+  uint64_t found = 0;
+  uint64_t touched = 0;
+  clock_t start = clock();
+  for(uint16_t q=0; q<queries; q++) {
+    x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+    uint64_t from = ARCHIVE_BENCH_START + (span>window ? (uint64_t)x * 1000 % (span-window) : 0);
+    if(ranges) {
+      float lo, hi;
+      found += reader.range(from, from+window, &lo, &hi) ? 1 : 0;
+    } else {
+      found += reader.query(from, from+window, time, lux, size);
+    }
+    touched += reader.touched();
+  }
+  double seconds = (double)(clock()-start) / CLOCKS_PER_SEC;
+  fprintf(out, "archive        %-12s %8.0f queries/s", name, seconds>0 ? queries / seconds : 0);
+  if(!ranges) {
+    fprintf(out, " %8.1f Mrecords/s", seconds>0 ? found / seconds / 1e6 : 0);
+  }
+  fprintf(out, " segments touched=%.2f of %u\n", (double)touched / queries, reader.segments());
+}
+
+void archiveBenchmark(FILE* out, const char* path, uint32_t records) {
+  unlink(path);
+  BH1750ArchiveWriter writer;
+  if(!writer.open(path, 1)) {
+    fprintf(out, "archive        cannot create %s\n", path);
+    return;
+  }
+  clock_t start = clock();
+  bh1750_measurement_t m;
+  m.mode = BH1750_ONE_TIME_HIGH_RES_MODE;
+  for(uint32_t i=0; i<records; i++) {
+    // day cycle with full sun at noon and 0.5 lx at night, MTreg as chosen by RESOLUTION_AUTO_HIGH
+    float level = 0.5f + 50000.0f * fmaxf(0, sinf(2 * (float)M_PI * (i % 86400) / 86400.0f));
+    m.MTreg = level<10 ? BH1750_MTREG_MAX : (level<5000 ? BH1750_MTREG_DEFAULT : BH1750_MTREG_MIN);
+    float raw = level * 1.2f * m.MTreg / BH1750_MTREG_DEFAULT;
+    m.raw = raw>65535 ? 65535 : (uint16_t)raw;
+    m.status = i%1000==999 ? BH1750_MEASUREMENT_ERROR : BH1750_MEASUREMENT_VALID;
+    if(!writer.append(ARCHIVE_BENCH_START + i * ARCHIVE_BENCH_INTERVAL, m)) {
+      fprintf(out, "archive        write failed\n");
+      return;
+    }
+  }
+  writer.flush();
+  double seconds = (double)(clock()-start) / CLOCKS_PER_SEC;
+  writer.close();
+
+  BH1750ArchiveReader reader;
+  if(!reader.open(path)) {
+    fprintf(out, "archive        cannot open %s\n", path);
+    return;
+  }
+  struct stat st;
+  stat(path, &st);
+  fprintf(out, "archive        write        %8.1f Mrecords/s %u records %.2f bytes/record\n",
+    seconds>0 ? records / seconds / 1e6 : 0, (unsigned)reader.count(), (double)st.st_size / records);
+
+  size_t size = ARCHIVE_BENCH_DAY / ARCHIVE_BENCH_INTERVAL + 1;
+  uint64_t* time = (uint64_t*)malloc(size * sizeof(uint64_t));
+  float* lux = (float*)malloc(size * sizeof(float));
+  if(time && lux) {
+    archiveQueryLine(out, reader, "query hour", ARCHIVE_BENCH_HOUR, records, time, lux, size, 10000, false);
+    archiveQueryLine(out, reader, "query day", ARCHIVE_BENCH_DAY, records, time, lux, size, 1000, false);
+    archiveQueryLine(out, reader, "range hour", ARCHIVE_BENCH_HOUR, records, time, lux, size, 10000, true);
+    archiveQueryLine(out, reader, "range day", ARCHIVE_BENCH_DAY, records, time, lux, size, 1000, true);
+  }
+  free(time);
+  free(lux);
+  reader.close();
+}
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Archive_h
+#define AS_BH1750Archive_h
+
+/*
+ Append-only columnar archive of measurements for long-term storage (host builds
+ with POSIX mmap only, BH1750_HOST defined).
+
+ One file per sensor. After a header page, the file consists of segments of
+ BH1750_ARCHIVE_RECORDS records. Every segment starts with an index page
+ (bh1750_archive_index_t: number of records, time range, min/max of raw value,
+ MTreg and lux) followed by one column block each for timestamps, raw values,
+ MTreg, hardware mode and status; all blocks are page aligned:
+
+   | header | index | time ...... | raw ... | MTreg | mode | status | index | time ...
+
+ The writer appends through a shared mapping: the columns and the summary of the
+ index are written first, then the record count of the segment is published with
+ release semantics. The reader loads the count with acquire semantics and only uses
+ records below it, so it never sees a half-written record, also while the writer
+ appends in another process; the summary of a segment is only relied on once the
+ segment is complete. The reader maps the whole file and maps it again when it has grown;
+ a range query only reads the index pages and the columns of the segments whose
+ time range overlaps the query, lux is computed from the raw columns with
+ convertBatchSoA (AS_BH1750Batch.h).
+
+ Timestamps are 64-bit values of the host (e.g. ms since the epoch), the archive
+ only requires them to be comparable.
+*/
+
+#ifdef BH1750_HOST
+
+#include "AS_BH1750Defs.h"
+#include <stdio.h>
+
+// Archive file identification
+#define BH1750_ARCHIVE_MAGIC 0x41484231UL // "1BHA"
+#define BH1750_ARCHIVE_VERSION 1
+
+// Block alignment (largest common page size, so the layout is portable)
+#define BH1750_ARCHIVE_PAGE 16384UL
+// Records per segment (one page per byte column)
+#define BH1750_ARCHIVE_RECORDS BH1750_ARCHIVE_PAGE
+
+// Block offsets within a segment
+#define BH1750_ARCHIVE_TIME_OFFSET BH1750_ARCHIVE_PAGE
+#define BH1750_ARCHIVE_RAW_OFFSET (BH1750_ARCHIVE_TIME_OFFSET + BH1750_ARCHIVE_RECORDS * 8)
+#define BH1750_ARCHIVE_MTREG_OFFSET (BH1750_ARCHIVE_RAW_OFFSET + BH1750_ARCHIVE_RECORDS * 2)
+#define BH1750_ARCHIVE_MODE_OFFSET (BH1750_ARCHIVE_MTREG_OFFSET + BH1750_ARCHIVE_PAGE)
+#define BH1750_ARCHIVE_STATUS_OFFSET (BH1750_ARCHIVE_MODE_OFFSET + BH1750_ARCHIVE_PAGE)
+#define BH1750_ARCHIVE_SEGMENT_BYTES (BH1750_ARCHIVE_STATUS_OFFSET + BH1750_ARCHIVE_PAGE)
+
+/** File header (first page). */
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t sensor;          /** Sensor id given to the writer. */
+  uint32_t recordsPerSegment;
+  uint32_t segmentBytes;
+  }
+  bh1750_archive_header_t;
+
+/** Index of a segment (start of its first page). */
+typedef struct
+{
+  uint64_t timeMin;   /** Smallest timestamp. */
+  uint64_t timeMax;   /** Largest timestamp. */
+  uint32_t count;     /** Number of records. */
+  uint32_t valid;     /** Number of records with BH1750_MEASUREMENT_VALID. */
+  float luxMin;       /** Smallest light level of the valid records. */
+  float luxMax;       /** Largest light level of the valid records. */
+  uint16_t rawMin;    /** Smallest raw value of the valid records. */
+  uint16_t rawMax;    /** Largest raw value of the valid records. */
+  uint8_t MTregMin;   /** Smallest MTreg of the valid records. */
+  uint8_t MTregMax;   /** Largest MTreg of the valid records. */
+  uint8_t reserved[2];
+  }
+  bh1750_archive_index_t;
+
+/**
+ * Appends measurements to an archive file.
+ */
+class BH1750ArchiveWriter {
+public:
+  BH1750ArchiveWriter(void);
+  ~BH1750ArchiveWriter(void);
+
+  /**
+   * Opens (or creates) the archive of a sensor. An existing archive is continued,
+   * it must belong to the same sensor.
+   */
+  bool open(const char* path, uint32_t sensor);
+
+  /**
+   * Appends a measurement record (raw value, MTreg, mode, status) with the given timestamp.
+   */
+  bool append(uint64_t time, const bh1750_measurement_t& m);
+
+  /**
+   * Appends a raw record (readRaw) with the given timestamp, as valid measurement.
+   */
+  bool append(uint64_t time, const bh1750_record_t& r);
+
+  /**
+   * Writes the mapped pages to the file.
+   */
+  bool flush(void);
+
+  void close(void);
+
+  /**
+   * Number of records in the archive.
+   */
+  uint64_t count(void);
+
+private:
+  int _fd;
+  uint8_t* _map;
+  size_t _mapBytes;
+  uint32_t _segments;
+
+  bool mapSegments(uint32_t segments);
+  bool store(uint64_t time, uint16_t raw, uint8_t mtreg, uint8_t mode, uint8_t status);
+};
+
+/**
+ * Reads an archive file (read-only mapping). count(), query() and range() include
+ * the segments appended since open() or the last call.
+ */
+class BH1750ArchiveReader {
+public:
+  BH1750ArchiveReader(void);
+  ~BH1750ArchiveReader(void);
+
+  bool open(const char* path);
+  void close(void);
+
+  uint32_t sensor(void);
+  uint32_t segments(void);
+  uint64_t count(void);
+
+  /**
+   * Index of a segment (0..segments()-1).
+   */
+  const bh1750_archive_index_t* index(uint32_t segment);
+
+  /**
+   * Valid measurements with from <= time <= to, in the stored order.
+   * Writes at most 'size' timestamps and light levels, returns the number written.
+   */
+  size_t query(uint64_t from, uint64_t to, uint64_t* time, float* lux, size_t size);
+
+  /**
+   * Smallest and largest light level of the valid measurements with from <= time <= to.
+   * Complete segments lying in the range are answered from the index.
+   * Returns false if there is no such measurement.
+   */
+  bool range(uint64_t from, uint64_t to, float* luxMin, float* luxMax);
+
+  /**
+   * Number of segments whose columns the last query or range had to read.
+   */
+  uint32_t touched(void);
+
+private:
+  int _fd;
+  const uint8_t* _map;
+  size_t _mapBytes;
+  uint32_t _segments;
+  uint32_t _touched;
+
+  bool remap(void);
+  uint32_t published(const bh1750_archive_index_t* index);
+};
+
+/**
+ * Writes 'records' simulated measurements (one per second, light following a day
+ * cycle with changing MTreg) into an archive at 'path', then runs range queries of
+ * one hour and one day. Reports write rate, file size per record, query throughput
+ * and the share of segments touched (host builds only).
+ */
+void archiveBenchmark(FILE* out, const char* path, uint32_t records);
+
+#endif
+
+#endif
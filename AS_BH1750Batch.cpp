@@ -0,0 +1,326 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Batch.h"
+
+#ifdef BH1750_HOST
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if !defined(BH1750_BATCH_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define BH1750_BATCH_AVX2
+#elif !defined(BH1750_BATCH_SCALAR) && (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BH1750_BATCH_NEON
+#endif
+#endif
+
+/**
+ * Converts the records in one pass. Scale and unit are only looked up again
+ * when MTreg or resolution change from one record to the next.
+ */
+void convertBatch(const bh1750_record_t* records, float* lux, size_t count) {
+  uint8_t mtreg = 0;
+  uint8_t mode = 0;
+  uint32_t scale = 0;
+  float unit = 0;
+  for(size_t i=0; i<count; i++) {
+    const bh1750_record_t& r = records[i];
+    if(r.MTreg!=mtreg || r.mode!=mode) {
+      mtreg = r.MTreg;
+      mode = r.mode;
+      if(mtreg<BH1750_MTREG_MIN || mtreg>BH1750_MTREG_MAX) {
+        scale = 0; // invalid MTreg
+      } else {
+        scale = bh1750Scale(mtreg);
+        unit = (mode&0x0F)==0x01 ? 1.0f / (2UL << BH1750_SCALE_SHIFT) : 1.0f / (1UL << BH1750_SCALE_SHIFT);
+      }
+    }
+    lux[i] = scale ? (float)(r.raw * scale) * unit : -1;
+  }
+}
+
+#ifdef BH1750_HOST
+
+// lux per count of H-resolution mode 2 and of the other modes
+#define BH1750_BATCH_UNIT_HALF (1.0f / (2UL << BH1750_SCALE_SHIFT))
+#define BH1750_BATCH_UNIT (1.0f / (1UL << BH1750_SCALE_SHIFT))
+
+/**
+ * Converts one value like bh1750Lux (invalid MTreg: -1).
+ */
+static inline float convertOne(uint16_t raw, uint8_t mtreg, uint8_t mode) {
+  if(mtreg<BH1750_MTREG_MIN || mtreg>BH1750_MTREG_MAX) {
+    return -1;
+  }
+  uint32_t level = (uint32_t)raw * bh1750Scale(mtreg);
+  return level * ((mode&0x0F)==0x01 ? BH1750_BATCH_UNIT_HALF : BH1750_BATCH_UNIT);
+}
+
+void convertBatchSoAScalar(const uint16_t* raw, const uint8_t* mtreg, const uint8_t* mode, float* lux, size_t count) {
+  for(size_t i=0; i<count; i++) {
+    lux[i] = convertOne(raw[i], mtreg[i], mode[i]);
+  }
+}
+
+#if defined(BH1750_BATCH_AVX2) || defined(BH1750_BATCH_NEON)
+/**
+ * Scale (Q15) for every possible MTreg byte, 0 for invalid values,
+ * so the kernels look up without range check.
+ */
+struct BatchScaleTable {
+  uint32_t scale[256];
+
+  BatchScaleTable() {
+    for(uint16_t mt=0; mt<256; mt++) {
+      scale[mt] = (mt>=BH1750_MTREG_MIN && mt<=BH1750_MTREG_MAX) ? bh1750Scale(mt) : 0;
+    }
+  }
+};
+
+static const uint32_t* batchScaleTable(void) {
+  static const BatchScaleTable table;
+  return table.scale;
+}
+#endif
+
+#if defined(BH1750_BATCH_AVX2)
+/**
+ * AVX2: 8 values per iteration, the scale is gathered from the table.
+ * AVX2 has no unsigned conversion, the product (up to 32 bits) is converted in two
+ * 16-bit halves: hi * 2^16 and lo are exact, so their sum is rounded only once.
+ */
+void convertBatchSoA(const uint16_t* raw, const uint8_t* mtreg, const uint8_t* mode, float* lux, size_t count) {
+  const int* table = (const int*)batchScaleTable();
+  const __m256i low16 = _mm256_set1_epi32(0xFFFF);
+  const __m256i nibble = _mm256_set1_epi32(0x0F);
+  const __m256i one = _mm256_set1_epi32(0x01);
+  const __m256 unit = _mm256_set1_ps(BH1750_BATCH_UNIT);
+  const __m256 unitHalf = _mm256_set1_ps(BH1750_BATCH_UNIT_HALF);
+  const __m256 invalid = _mm256_set1_ps(-1.0f);
+  const __m256 two16 = _mm256_set1_ps(65536.0f);
+  size_t i = 0;
+  for(; i+8<=count; i+=8) {
+    __m256i r = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(raw+i)));
+    __m256i mt = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(mtreg+i)));
+    __m256i m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(mode+i)));
+    __m256i scale = _mm256_i32gather_epi32(table, mt, 4);
+    __m256i level = _mm256_mullo_epi32(r, scale);
+    __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(level, 16));
+    __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(level, low16));
+    __m256 flevel = _mm256_add_ps(_mm256_mul_ps(hi, two16), lo);
+    __m256 half = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(m, nibble), one));
+    __m256 result = _mm256_mul_ps(flevel, _mm256_blendv_ps(unit, unitHalf, half));
+    __m256 zero = _mm256_castsi256_ps(_mm256_cmpeq_epi32(scale, _mm256_setzero_si256()));
+    _mm256_storeu_ps(lux+i, _mm256_blendv_ps(result, invalid, zero));
+  }
+  convertBatchSoAScalar(raw+i, mtreg+i, mode+i, lux+i, count-i);
+}
+
+const char* convertBatchKernel(void) {
+  return "avx2";
+}
+#elif defined(BH1750_BATCH_NEON)
+/**
+ * NEON: 4 values per iteration. NEON has no gather, the scale is read per lane
+ * from the table; multiply (16 x 16 -> 32 bit), unsigned conversion and unit are vectorized.
+ */
+void convertBatchSoA(const uint16_t* raw, const uint8_t* mtreg, const uint8_t* mode, float* lux, size_t count) {
+  const uint32_t* table = batchScaleTable();
+  const uint32x4_t nibble = vdupq_n_u32(0x0F);
+  const uint32x4_t one = vdupq_n_u32(0x01);
+  const float32x4_t unit = vdupq_n_f32(BH1750_BATCH_UNIT);
+  const float32x4_t unitHalf = vdupq_n_f32(BH1750_BATCH_UNIT_HALF);
+  const float32x4_t invalid = vdupq_n_f32(-1.0f);
+  size_t i = 0;
+  for(; i+4<=count; i+=4) {
+    const uint32_t s[4] = { table[mtreg[i]], table[mtreg[i+1]], table[mtreg[i+2]], table[mtreg[i+3]] };
+    const uint32_t md[4] = { mode[i], mode[i+1], mode[i+2], mode[i+3] };
+    uint32x4_t scale = vld1q_u32(s);
+    uint32x4_t level = vmulq_u32(vmovl_u16(vld1_u16(raw+i)), scale);
+    uint32x4_t half = vceqq_u32(vandq_u32(vld1q_u32(md), nibble), one);
+    float32x4_t result = vmulq_f32(vcvtq_f32_u32(level), vbslq_f32(half, unitHalf, unit));
+    vst1q_f32(lux+i, vbslq_f32(vceqzq_u32(scale), invalid, result));
+  }
+  convertBatchSoAScalar(raw+i, mtreg+i, mode+i, lux+i, count-i);
+}
+
+const char* convertBatchKernel(void) {
+  return "neon";
+}
+#else
+void convertBatchSoA(const uint16_t* raw, const uint8_t* mtreg, const uint8_t* mode, float* lux, size_t count) {
+  convertBatchSoAScalar(raw, mtreg, mode, lux, count);
+}
+
+const char* convertBatchKernel(void) {
+  return "scalar";
+}
+#endif
+
+/**
+ * Records per second of 'rounds' calls of the conversion.
+ */
+static double batchRate(void (*convert)(const void*, float*, size_t), const void* data, float* lux, size_t count, uint8_t rounds) {
+  clock_t start = clock();
+  for(uint8_t k=0; k<rounds; k++) {
+    convert(data, lux, count);
+  }
+  double seconds = (double)(clock()-start) / CLOCKS_PER_SEC;
+  return seconds>0 ? (double)count * rounds / seconds : 0;
+}
+
+// Input of the benchmark (both layouts)
+typedef struct
+{
+  const bh1750_record_t* records;
+  const uint16_t* raw;
+  const uint8_t* mtreg;
+  const uint8_t* mode;
+  }
+  batch_input_t;
+
+static void batchRecords(const void* data, float* lux, size_t count) {
+  convertBatch(((const batch_input_t*)data)->records, lux, count);
+}
+
+static void batchScalar(const void* data, float* lux, size_t count) {
+  const batch_input_t* in = (const batch_input_t*)data;
+  convertBatchSoAScalar(in->raw, in->mtreg, in->mode, lux, count);
+}
+
+static void batchKernel(const void* data, float* lux, size_t count) {
+  const batch_input_t* in = (const batch_input_t*)data;
+  convertBatchSoA(in->raw, in->mtreg, in->mode, lux, count);
+}
+
+static const uint8_t batchModes[] = { BH1750_ONE_TIME_HIGH_RES_MODE, BH1750_ONE_TIME_HIGH_RES_MODE_2, BH1750_ONE_TIME_LOW_RES_MODE,
+  BH1750_CONTINUOUS_HIGH_RES_MODE, BH1750_CONTINUOUS_HIGH_RES_MODE_2, BH1750_CONTINUOUS_LOW_RES_MODE };
+
+void batchBenchmark(FILE* out, size_t count) {
+  bh1750_record_t* records = (bh1750_record_t*)malloc(count * sizeof(bh1750_record_t));
+  uint16_t* raw = (uint16_t*)malloc(count * sizeof(uint16_t));
+  uint8_t* mtreg = (uint8_t*)malloc(count);
+  uint8_t* mode = (uint8_t*)malloc(count);
+  float* reference = (float*)malloc(count * sizeof(float));
+  float* lux = (float*)malloc(count * sizeof(float));
+  if(!records || !raw || !mtreg || !mode || !reference || !lux) {
+    fprintf(out, "batch          out of memory\n");
+  } else {
+    // runs of 1..64 records with the same MTreg (sometimes invalid) and mode, random raw values
+    uint32_t x = 0x2545F491UL;
+    size_t i = 0;
+    while(i<count) {
+      x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+      uint8_t mt = (x>>8)&0x3F ? BH1750_MTREG_MIN + (x>>16) % (BH1750_MTREG_MAX-BH1750_MTREG_MIN+1) : (uint8_t)(x>>24);
+      uint8_t md = batchModes[(x>>4) % sizeof(batchModes)];
+      for(size_t end = i + 1 + (x&0x3F); i<end && i<count; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        raw[i] = records[i].raw = (uint16_t)x;
+        mtreg[i] = records[i].MTreg = mt;
+        mode[i] = records[i].mode = md;
+      }
+    }
+    batch_input_t in = { records, raw, mtreg, mode };
+    const uint8_t rounds = 20;
+    double rateScalar = batchRate(&batchScalar, &in, reference, count, rounds);
+    double rateRecords = batchRate(&batchRecords, &in, lux, count, rounds);
+    bool recordsExact = memcmp(lux, reference, count * sizeof(float))==0;
+    double rateKernel = batchRate(&batchKernel, &in, lux, count, rounds);
+    bool kernelExact = memcmp(lux, reference, count * sizeof(float))==0;
+    fprintf(out, "batch          scalar         %8.1f Mrecords/s\n", rateScalar / 1e6);
+    fprintf(out, "batch          convertBatch   %8.1f Mrecords/s bit-exact=%s\n", rateRecords / 1e6, recordsExact ? "yes" : "NO");
+    fprintf(out, "batch          %-14s %8.1f Mrecords/s bit-exact=%s\n", convertBatchKernel(), rateKernel / 1e6, kernelExact ? "yes" : "NO");
+  }
+  free(records);
+  free(raw);
+  free(mtreg);
+  free(mode);
+  free(reference);
+  free(lux);
+}
+
+/**
+ * Differing values of two conversions (bitwise).
+ */
+static unsigned long batchDiffers(const float* a, const float* b, size_t count) {
+  unsigned long n = 0;
+  for(size_t i=0; i<count; i++) {
+    n += memcmp(a+i, b+i, sizeof(float))!=0;
+  }
+  return n;
+}
+
+unsigned long batchExactCheck(FILE* out) {
+  const size_t count = 65536;
+  bh1750_record_t* records = (bh1750_record_t*)malloc(count * sizeof(bh1750_record_t));
+  uint16_t* raw = (uint16_t*)malloc(count * sizeof(uint16_t));
+  uint8_t* mtreg = (uint8_t*)malloc(count);
+  uint8_t* mode = (uint8_t*)malloc(count);
+  float* reference = (float*)malloc(count * sizeof(float));
+  float* lux = (float*)malloc(count * sizeof(float));
+  unsigned long kernel = 0;
+  unsigned long tail = 0;
+  unsigned long batch = 0;
+  if(!records || !raw || !mtreg || !mode || !reference || !lux) {
+    fprintf(out, "batch          out of memory\n");
+    kernel = 1;
+  } else {
+    for(size_t i=0; i<count; i++) {
+      raw[i] = records[i].raw = (uint16_t)i;
+    }
+    for(uint8_t m=0; m<sizeof(batchModes); m++) {
+      for(uint16_t mt=0; mt<256; mt++) {
+        memset(mtreg, mt, count);
+        memset(mode, batchModes[m], count);
+        for(size_t i=0; i<count; i++) {
+          records[i].MTreg = mt;
+          records[i].mode = batchModes[m];
+        }
+        convertBatchSoAScalar(raw, mtreg, mode, reference, count);
+        convertBatchSoA(raw, mtreg, mode, lux, count);
+        kernel += batchDiffers(lux, reference, count);
+        // unaligned start and a tail for the scalar remainder of the kernel
+        convertBatchSoA(raw+1, mtreg+1, mode+1, lux+1, count-4);
+        tail += batchDiffers(lux+1, reference+1, count-4);
+        convertBatch(records, lux, count);
+        batch += batchDiffers(lux, reference, count);
+      }
+    }
+  }
+  fprintf(out, "batch          %-6s full range: %lu values, differing: kernel=%lu unaligned=%lu convertBatch=%lu\n",
+    convertBatchKernel(), (unsigned long)count * 256 * sizeof(batchModes), kernel, tail, batch);
+  free(records);
+  free(raw);
+  free(mtreg);
+  free(mode);
+  free(reference);
+  free(lux);
+  return kernel + tail + batch;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Batch_h
+#define AS_BH1750Batch_h
+
+#include "AS_BH1750Defs.h"
+#include "AS_BH1750Tables.h"
+
+#ifdef BH1750_HOST
+#include <stdio.h>
+#endif
+
+/*
+ Deferred conversion of raw values (bh1750_record_t, see readRaw and readRawAsync).
+
+ A data logger stores the raw records and converts them later in bulk, e.g. on a
+ host. Consecutive records with the same MTreg and resolution share one scale
+ factor, so the inner loop is one integer multiply and one float multiply per
+ record. The result is bit-exact with the conversion of the drivers (bh1750Lux).
+
+ Host builds (BH1750_HOST) additionally convert structure-of-arrays buffers
+ (convertBatchSoA) with a vector kernel selected at compile time: AVX2
+ (-mavx2 or -march=native) or NEON (AArch64), scalar otherwise or with
+ BH1750_BATCH_SCALAR defined. All kernels deliver the same bits as the scalar
+ reference: the product raw * scale (Q15) is converted to float with one
+ rounding and then multiplied by a power of two.
+*/
+
+/**
+ * Converts 'count' raw records into lux values.
+ * Records with an invalid MTreg (outside BH1750_MTREG_MIN..BH1750_MTREG_MAX) yield -1.
+ */
+void convertBatch(const bh1750_record_t* records, float* lux, size_t count);
+
+#ifdef BH1750_HOST
+/**
+ * Converts 'count' raw values given as separate arrays (raw value, MTreg, hardware mode)
+ * into lux values, with the vector kernel of the build (see convertBatchKernel()).
+ * Values with an invalid MTreg yield -1. Host builds only.
+ */
+void convertBatchSoA(const uint16_t* raw, const uint8_t* mtreg, const uint8_t* mode, float* lux, size_t count);
+
+/**
+ * Scalar reference of convertBatchSoA (host builds only).
+ */
+void convertBatchSoAScalar(const uint16_t* raw, const uint8_t* mtreg, const uint8_t* mode, float* lux, size_t count);
+
+/**
+ * Name of the kernel used by convertBatchSoA: "avx2", "neon" or "scalar".
+ */
+const char* convertBatchKernel(void);
+
+/**
+ * Converts 'count' random records (runs of changing MTreg and mode) repeatedly with
+ * convertBatch, the scalar reference and the vector kernel, checks that the results
+ * are bit-identical and reports records per second (host builds only).
+ */
+void batchBenchmark(FILE* out, size_t count);
+
+/**
+ * Converts every raw value (0..65535) with every MTreg byte (0..255) and every hardware mode
+ * with the vector kernel (aligned and with an odd tail) and with convertBatch, and compares
+ * the bits with the scalar reference. Returns the number of differing values (host builds only).
+ */
+unsigned long batchExactCheck(FILE* out);
+#endif
+
+#endif
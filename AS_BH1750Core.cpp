@@ -0,0 +1,1503 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Core.h"
+
+// For nodes with many sensors: the state of one sensor must stay under 8 bytes.
+static_assert(sizeof(AS_BH1750Core)<=7, "AS_BH1750Core: packed state exceeds 7 bytes");
+
+// Debug-Flag
+#define BH1750_DEBUG 0
+
+// Old cores without pull-up mode: external pull-ups are required anyway
+#ifndef INPUT_PULLUP
+#define INPUT_PULLUP INPUT
+#endif
+
+// Circuit breaker configuration and counters (shared by all sensors)
+uint8_t AS_BH1750Core::_failureThreshold = BH1750_BREAKER_THRESHOLD;
+uint8_t AS_BH1750Core::_sdaPin = 255;
+uint8_t AS_BH1750Core::_sclPin = 255;
+bh1750_breaker_stats_t AS_BH1750Core::_breakerStats;
+unsigned long AS_BH1750Core::_busTimeout = BH1750_BUS_TIMEOUT;
+uint8_t AS_BH1750Core::_resolutionTarget = 0;
+bool AS_BH1750Core::_verify = false;
+
+/**
+ * Constructor.
+ * Allows to change the I2C address of the sensor.
+ * Default address: 0x23, alternative address: 0x5C.
+ * Constants are defined as: BH1750_DEFAULT_I2CADDR and BH1750_SECOND_I2CADDR.
+ * When not specified, the default address is used.
+ * To use the alternative address, the sensor pin 'ADR' of the chip must be set to VCC.
+ */
+AS_BH1750Core::AS_BH1750Core(uint8_t address) {
+  _address = address;
+  _hardwareMode = BH1750_NO_MODE;
+  _MTreg = 0;
+  _flicker = 0;
+  _warm = false;
+  setLastRaw(0);
+  _backoff = 0;
+  _health = 0;
+  _timedOut = false;
+  _wakeUp = false;
+}
+
+/**
+* Performs the first initialization of the sensor.
+ * Possible parameters:
+ * - Sensor resolution mode:
+ * - RESOLUTION_LOW: Physical sensor mode with 4 lx resolution. Measurement time approx. 16ms. Range 0-54612.
+ * - RESOLUTION_NORMAL: Physical sensor mode with 1 lx resolution. Measurement time approx. 120ms. Range 0-54612.
+ * - RESOLUTION_HIGH: Physical sensor mode with 0.5 lx resolution. Measurement time approx. 120ms. Range 0-54612.
+ * (The measuring ranges can be moved by changing the MTreg.)
+ * - RESOLUTION_AUTO_HIGH: The values in the MTreg are automatically adjusted according to the brightness,
+ * that a maximum resolution and measuring range are achieved.
+ * The measurable values range from 0.11 lx to 100,000 lx.
+ * (I do not know how accurate the values are in border areas,
+ * especially with high values I have my doubts.
+ * However, the values seem to grow largely linearly with the increasing brightness.)
+ * Resolution in the lower range approximately 0.13 lx, in the middle 0.5 lx, in the upper approximately 1-2 lx.
+ * The measurement times are extended by multiple measurements and measurements
+ * the changes from Measurement Time (MTreg) to max. approx. 500 ms.
+ *
+ * - AutoPowerDown: true = The sensor is placed in the power saving mode after the measurement.
+ * The subsequent wake-up is performed automatically, but takes slightly more time.
+ *
+ * Default values: RESOLUTION_AUTO_HIGH, true
+ *
+ */
+bool AS_BH1750Core::begin(sensors_resolution_t mode, bool autoPowerDown, const bh1750_state_t* state) {
+#if BH1750_DEBUG == 1
+  Serial.print("  sensors_resolution_mode (virtual): ");
+  Serial.println(mode, DEC);
+#endif
+  setVirtualMode(mode);
+  _autoPowerDown = autoPowerDown;
+
+  // Restore the learned state (only if it was saved for the same configuration)
+  _warm = false;
+  if(state!=NULL && checkState(state) && state->virtualMode==mode && state->autoPowerDown==autoPowerDown) {
+    setFlickerCode(state->flickerFrequency);
+    setLastRaw(state->lastRaw);
+    // in automatic mode, the first measurement takes place in the last range without probe
+    _warm = (mode==RESOLUTION_AUTO_HIGH);
+  }
+  
+  beginBus();
+  _wakeUp = false;
+  _MTreg = 0; // force transmission (the sensor may have been reset in the meantime)
+
+  // actually normally unnecessary since standard (differs only if flicker-immune timing is active)
+  bool mtregDefined = defineMTReg(_warm?state->MTreg:flickerMTReg(BH1750_MTREG_DEFAULT, mode==RESOLUTION_LOW));
+
+  // Determine the hardware mode for the desired Virtual Mode
+  switch (mode) {
+  case RESOLUTION_LOW:
+    _hardwareMode = autoPowerDown?BH1750_ONE_TIME_LOW_RES_MODE:BH1750_CONTINUOUS_LOW_RES_MODE;
+    break;
+  case RESOLUTION_NORMAL:
+    _hardwareMode = autoPowerDown?BH1750_ONE_TIME_HIGH_RES_MODE:BH1750_CONTINUOUS_HIGH_RES_MODE;
+    break;
+  case RESOLUTION_HIGH:
+    _hardwareMode = autoPowerDown?BH1750_ONE_TIME_HIGH_RES_MODE_2:BH1750_CONTINUOUS_HIGH_RES_MODE_2;
+    break;
+  case RESOLUTION_AUTO_HIGH:
+    _hardwareMode = _warm?state->hardwareMode:BH1750_CONTINUOUS_LOW_RES_MODE;
+    break;
+  default:
+    // must not actually happen...
+    _hardwareMode = BH1750_NO_MODE;
+    break;
+  }
+
+#if BH1750_DEBUG == 1
+  Serial.print("hardware mode: ");
+  Serial.println(_hardwareMode, DEC);
+#endif
+
+  if(_hardwareMode==BH1750_NO_MODE) {
+    return false;
+  }
+
+  // Try to activate the selected hardware mode
+  if(mtregDefined && selectResolutionMode(_hardwareMode)){
+#if BH1750_DEBUG == 1
+    Serial.print("hardware mode defined successfully");
+    Serial.println(_hardwareMode, DEC);
+#endif
+    return true;
+  }
+
+  // Initialization failed
+#if BH1750_DEBUG == 1
+  Serial.print("failure to aktivate hardware mode ");
+  Serial.println(_hardwareMode, DEC);
+#endif
+  _hardwareMode = BH1750_NO_MODE;
+  return false;
+}
+
+/**
+ * Allow a check to see if a (responsive) BH1750 sensor is present.
+ */
+bool AS_BH1750Core::isPresent() {
+  // Check I2C Address
+  if(!isAddressed()) {
+    return false; 
+  }
+
+  // Check device: is it a BH1750
+  if(!isInitialized()) {
+    // previously inactive, therefore, to test fast one-time mode
+    //write8(BH1750_POWER_ON);
+    selectResolutionMode(BH1750_ONE_TIME_LOW_RES_MODE);
+    _hardwareMode=BH1750_NO_MODE;
+  } 
+  else {
+    // if once-mode was active, the sensor must be awakened
+    // (the measurement waits for the first conversion)
+    powerOn(); 
+  }
+
+  // Check whether values are actually delivered (last mode, auto-PowerDown will be executed)
+  bh1750_measurement_t m;
+  measure(&delay, &m);
+  return (m.status&BH1750_MEASUREMENT_VALID)!=0;
+}
+
+/**
+ * Awakens a sensor in power down mode (does not damage the 'wake up' sensor).
+ * Works only if the sensor has already been initialized.
+ */
+bool AS_BH1750Core::powerOn() {
+  if(!isInitialized()) {
+#if BH1750_DEBUG == 1
+    Serial.println("sensor not initialized");
+#endif
+    return false;
+  }
+
+  _valueReaded=false;
+  //write8(BH1750_POWER_ON); //
+  //fDelayPtr(10); // Nötig?
+  // Apparently the setting of HardwareMode sufficient also without PowerON command
+  return selectResolutionMode(_hardwareMode); // activate the last mode
+}
+
+/**
+ * Sends the sensor to power saving mode.
+ * Only works if the sensor has already been initialized.
+ */
+void AS_BH1750Core::powerDown() {
+  if(!isInitialized()) {
+#if BH1750_DEBUG == 1
+    Serial.println("sensor not initialized");
+#endif
+    return;
+  }
+
+  write8(BH1750_POWER_DOWN);
+  // the next measurement wakes the sensor up (also in continuous modes),
+  // a running measurement starts again
+  _wakeUp = true;
+}
+
+/**
+ * Sends to the sensor a command to select HardwareMode.
+ *
+ * Parameters:
+ * - mode: s.o.
+ *
+ * The caller has to wait BH1750_SETTLE_TIME before the measurement time begins.
+ */
+bool AS_BH1750Core::selectResolutionMode(uint8_t mode) {
+#if BH1750_DEBUG == 1
+    Serial.print("selectResolutionMode: ");
+    Serial.println(mode, DEC);
+#endif
+  if(!isInitialized()) {
+    return false;
+#if BH1750_DEBUG == 1
+    Serial.println("sensor not initialized");
+#endif
+  }
+
+  _hardwareMode=mode;
+  _valueReaded=false;
+
+  // Check whether a valid mode is present and, in the positive case, activate the desired mode
+  switch (mode) {
+  case BH1750_CONTINUOUS_HIGH_RES_MODE:
+  case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+  case BH1750_CONTINUOUS_LOW_RES_MODE:
+  case BH1750_ONE_TIME_HIGH_RES_MODE:
+  case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+  case BH1750_ONE_TIME_LOW_RES_MODE:
+    // Mode
+    if(write8(mode)) {
+    // Short pause necessary, otherwise the mode is not activated safely
+    // (e.g., in the AutoHigh mode, sensor provides alternately over-steered values, such as: 54612.5, 68123.4, 54612.5, 69345.3, ..)
+    // => caller waits BH1750_SETTLE_TIME
+      return true;
+    }
+    break;
+  default:
+    // Invalid measurement mode
+#if BH1750_DEBUG == 1
+    Serial.println("Invalid measurement mode");
+#endif
+    break;
+  }
+
+  return false;
+}
+
+/**
+ * Executes the next step of a measurement (stage machine shared by the blocking and the asynchronous driver).
+ * If the sensor is in power saving mode, it is automatically awakened.
+ * A measurement interrupted by powerDown() starts again with the wake-up.
+ * Returns true while the measurement is running (next step after job.wait ms),
+ * false when it is finished (BH1750_STAGE_DONE with the raw value in job.raw, or BH1750_STAGE_ERROR).
+ */
+bool AS_BH1750Core::step(bh1750_job_t& job) {
+  if(_wakeUp && job.stage>BH1750_STAGE_START && job.stage<BH1750_STAGE_DONE) {
+    // interrupted by powerDown(): start again with wake-up
+    job.stage = BH1750_STAGE_START;
+  }
+  // Steps without waiting time follow each other directly
+  for(;;) {
+    switch (job.stage) {
+    case BH1750_STAGE_START:
+#if BH1750_DEBUG == 1
+      Serial.print("call: readLightLevel. virtualMode: ");
+      Serial.println(virtualMode(), DEC);
+#endif
+      job.triggered = false;
+      job.estimate = 0;
+      if(!isInitialized()) {
+#if BH1750_DEBUG == 1
+        Serial.println("sensor not initialized");
+#endif
+        job.stage = BH1750_STAGE_ERROR;
+        return false;
+      }
+
+      {
+      _timedOut = false;
+#ifdef WIRE_HAS_TIMEOUT
+      BH1750_WIRE.clearWireTimeoutFlag();
+#endif
+      // Wake-up (the mode is sent again): after the automatic power down, after powerDown() or a bus error.
+      // Fixed one-time modes: every measurement triggers its own conversion.
+      bool wake = _wakeUp || (_autoPowerDown && (_valueReaded || virtualMode()!=RESOLUTION_AUTO_HIGH));
+      if(_backoff>0) {
+        // Circuit open: fail fast without bus access until the backoff has expired
+        if(_health>0) {
+          _health--;
+          _breakerStats.rejected++;
+          job.stage = BH1750_STAGE_ERROR;
+          return false;
+        }
+        // Half-open: recovery attempt, the sensor may have lost its settings
+        _breakerStats.halfOpened++;
+        recover();
+        _warm = false;
+        _wakeUp = true;
+        wake = true;
+      }
+
+      if(_warm) {
+        // Warm start (restored state): the measurement in the last range was already started by begin() or resume().
+        _warm = false;
+        job.stage = BH1750_STAGE_WARM;
+        job.wait = getModeDelay();
+        return true;
+      }
+
+      // Automatic mode requires special treatment.
+      // First, the brightness is read in the LowRes mode,
+      // depending on the range (dark, normal, very bright), the values of MTreg are set and
+      // the actual measurement is then carried out.
+      /*
+         The fixed limits may cause a 'jump' in the measurement curve.
+       In this case, a continuous adaptation of MTreg in border areas would probably be better.
+       For my purposes, however, this is of no importance.
+       */
+      job.stage = virtualMode()==RESOLUTION_AUTO_HIGH ? BH1750_STAGE_PROBE : BH1750_STAGE_MEASURE;
+
+      // ggf. PowerOn
+      if(wake && job.stage==BH1750_STAGE_PROBE) {
+        // automatic mode: the mode command of the probe wakes the sensor itself.
+        // A wake-up in the last mode would start a conversion that the probe discards.
+        if(_wakeUp) {
+          _MTreg = 0; // settings unknown: the probe transmits the MTreg again
+          _wakeUp = false;
+        }
+        break;
+      }
+      if(wake) {
+        if(_wakeUp || _verify) {
+          // settings unknown (bus error, recovery, or a corrupted command with verification): transmit the MTreg again
+          uint8_t mtreg = _MTreg;
+          _MTreg = 0; // force transmission
+          if(!defineMTReg(mtreg)) {
+            return finish(job, false);
+          }
+        }
+        if(!powerOn()) {
+          // sensor does not respond, no need to wait
+          return finish(job, false);
+        }
+        _wakeUp = false;
+        // fixed modes: the wake-up starts the measurement itself
+        job.triggered = job.stage==BH1750_STAGE_MEASURE;
+        job.wait = BH1750_SETTLE_TIME + (job.triggered ? getModeDelay() : 0);
+        return true;
+      }
+      if(job.stage==BH1750_STAGE_MEASURE && !_valueReaded) {
+        // continuous mode: the first measurement after the mode command may not be complete yet
+        job.wait = BH1750_SETTLE_TIME + getModeDelay();
+        return true;
+      }
+      break;
+      }
+
+    case BH1750_STAGE_WARM:
+    {
+      uint16_t raw;
+      job.stage = virtualMode()==RESOLUTION_AUTO_HIGH ? BH1750_STAGE_PROBE : BH1750_STAGE_MEASURE;
+      if(readRawLevel(raw)) {
+        if(virtualMode()!=RESOLUTION_AUTO_HIGH) {
+          job.raw = raw;
+          return finish(job, true);
+        }
+        // If the value still belongs to this range, the probe is not necessary.
+        uint8_t mtreg;
+        uint8_t mode;
+        // Probe level equivalent (LowResMode, MTreg 69): lux * 1.2
+        float lux = convertRawValue(raw);
+        autoRange(lux*1.2<65535 ? lux*1.2 : 65535, mtreg, mode);
+        if(mtreg==_MTreg && mode==_hardwareMode) {
+          job.raw = raw;
+          return finish(job, true);
+        }
+      }
+      break;
+    }
+
+    case BH1750_STAGE_PROBE:
+      if(_verify) {
+        _MTreg = 0; // transmit the MTreg again
+      }
+      if(!defineMTReg(BH1750_MTREG_DEFAULT) || !selectResolutionMode(BH1750_CONTINUOUS_LOW_RES_MODE)) {
+        return finish(job, false);
+      }
+      job.stage = BH1750_STAGE_RANGE;
+      job.wait = BH1750_SETTLE_TIME + getModeDelay(); // Reading time in LowResMode
+      return true;
+
+    case BH1750_STAGE_RANGE:
+    {
+      uint16_t level;
+      if(!readRawLevel(level)) {
+        return finish(job, false);
+      }
+#if BH1750_DEBUG == 1
+      Serial.print("AutoHighMode: check level read: ");
+      Serial.println(level, DEC);
+#endif
+      job.estimate = level;
+      // The probe is sufficient if its quantisation relative to the reading meets the resolution target:
+      // BH1750_PROBE_STEP / level <= target / 1000
+      if(_resolutionTarget>0 && level<65535 && (uint32_t)level*_resolutionTarget>=BH1750_PROBE_STEP*1000UL) {
+        job.raw = level; // converted with MTreg and mode of the probe
+        if(_autoPowerDown) {
+          // the probe runs in continuous mode
+          write8(BH1750_POWER_DOWN);
+        }
+        return finish(job, true);
+      }
+      uint8_t mtreg;
+      uint8_t mode;
+      autoRange(level, mtreg, mode);
+      if(_verify) {
+        // stop the probe and clear the data register: a lost mode command then reads 0, not the probe
+        _MTreg = 0;
+        if(!write8(BH1750_POWER_DOWN) || !write8(BH1750_POWER_ON) || !write8(BH1750_RESET)) {
+          return finish(job, false);
+        }
+      }
+      if(!defineMTReg(mtreg) || !selectResolutionMode(mode)) {
+        return finish(job, false);
+      }
+      job.stage = BH1750_STAGE_MEASURE;
+      job.triggered = true;
+      job.wait = BH1750_SETTLE_TIME + getModeDelay();
+      return true;
+    }
+
+    case BH1750_STAGE_MEASURE:
+      // Hardware read value
+      if(!readRawLevel(job.raw)) {
+        return finish(job, false);
+      }
+      // verified automatic mode: 0 after a lit probe means the mode command was lost
+      return finish(job, !(_verify && job.raw==0 && job.estimate>0));
+
+    default:
+      // finished (or not started)
+      return false;
+    }
+  }
+}
+
+/**
+ * Finishes a measurement and updates the circuit breaker.
+ * Closed: counts consecutive failures and opens the circuit at the threshold.
+ * Half-open (recovery attempt): closes on success, otherwise opens again with doubled backoff.
+ * Returns false (end of the stage machine).
+ */
+bool AS_BH1750Core::finish(bh1750_job_t& job, bool ok) {
+  job.stage = ok ? BH1750_STAGE_DONE : (_timedOut ? BH1750_STAGE_TIMEOUT : BH1750_STAGE_ERROR);
+  if(!ok) {
+    // the sensor state is unknown after a bus error: the next measurement sends the mode again
+    _wakeUp = true;
+  }
+  if(ok) {
+    if(_backoff>0) {
+      _breakerStats.closed++;
+    }
+    _backoff = 0;
+    _health = 0;
+  }
+  else if(_backoff>0) {
+    _breakerStats.reopened++;
+    if(_backoff<BH1750_BREAKER_MAX_BACKOFF) {
+      _backoff++;
+    }
+    _health = 1<<(_backoff-1);
+  }
+  else if(_failureThreshold>0 && ++_health>=_failureThreshold) {
+    _breakerStats.opened++;
+    _backoff = 1;
+    _health = 1;
+  }
+  return false;
+}
+
+/**
+ * Recovery attempt of an open circuit: bus clear and bus initialization.
+ * MTreg and mode are sent again by the following wake-up.
+ */
+void AS_BH1750Core::recover(void) {
+  busClear();
+  beginBus();
+}
+
+/**
+ * Frees a bus blocked by a slave holding SDA low (e.g. after a reset in the middle of a transfer):
+ * 9 clock pulses on SCL, then a STOP condition. Only with pins set by setBusClearPins.
+ * The lines are driven like open drain (low or released with pull-up).
+ */
+void AS_BH1750Core::busClear(void) {
+  if(_sdaPin==255 || _sclPin==255) {
+    return;
+  }
+  _breakerStats.busClears++;
+  pinMode(_sdaPin, INPUT_PULLUP);
+  for(uint8_t i=0; i<9; i++) {
+    digitalWrite(_sclPin, LOW);
+    pinMode(_sclPin, OUTPUT);
+    delayMicroseconds(5);
+    pinMode(_sclPin, INPUT_PULLUP);
+    delayMicroseconds(5);
+  }
+  // STOP: SDA low -> high while SCL is high
+  digitalWrite(_sdaPin, LOW);
+  pinMode(_sdaPin, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(_sdaPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+}
+
+/**
+ * Ends a bus transaction. Returns true on success, a timeout (status 5) is noted for the measurement.
+ */
+bool AS_BH1750Core::endTransmission(void) {
+  uint8_t status = BH1750_WIRE.endTransmission();
+#ifdef WIRE_HAS_TIMEOUT
+  // the flag of the bus also covers a preceding requestFrom; it is taken over by the sensor
+  // of this transaction at once, so a timeout of another sensor is never reported here
+  if(BH1750_WIRE.getWireTimeoutFlag()) {
+    status = 5;
+    BH1750_WIRE.clearWireTimeoutFlag();
+  }
+#endif
+  if(status==5) {
+    _timedOut = true;
+  }
+  return status==0;
+}
+
+/**
+ * Initializes the bus, with the transaction time budget if supported by the Wire library.
+ */
+void AS_BH1750Core::beginBus(void) {
+  BH1750_WIRE.begin();
+#if defined(WIRE_HAS_TIMEOUT)
+  BH1750_WIRE.setWireTimeout(_busTimeout, true);
+#elif defined(ARDUINO_ARCH_ESP32)
+  if(_busTimeout>0) {
+    BH1750_WIRE.setTimeOut((_busTimeout+999)/1000);
+  }
+#endif
+}
+
+/**
+ * Time budget of one bus transaction (us, 0: no timeout), applied by begin().
+ */
+void AS_BH1750Core::setBusTimeout(unsigned long timeout) {
+  _busTimeout = timeout;
+}
+
+/**
+ * Raw value equivalent to a lux threshold for the MTreg and hardware mode in use (cached in the threshold).
+ */
+uint16_t AS_BH1750Core::rawThreshold(bh1750_threshold_t* t) {
+  if(_MTreg<BH1750_MTREG_MIN || _MTreg>BH1750_MTREG_MAX) {
+    return 0xFFFF; // not initialized
+  }
+  if(t->MTreg!=_MTreg || t->mode!=_hardwareMode) {
+    t->raw = bh1750RawThreshold(t->lux, _MTreg, _hardwareMode);
+    t->MTreg = _MTreg;
+    t->mode = _hardwareMode;
+  }
+  return t->raw;
+}
+
+/**
+ * Checks whether the sensor acknowledges its I2C address.
+ */
+bool AS_BH1750Core::isAddressed(void) {
+  BH1750_WIRE.beginTransmission(_address);
+  return endTransmission();
+}
+
+/**
+ * Indicates whether the circuit breaker of this sensor is open.
+ */
+bool AS_BH1750Core::isCircuitOpen(void) {
+  return _backoff>0;
+}
+
+/**
+ * Consecutive failed measurements after which the circuit opens (0: never).
+ */
+void AS_BH1750Core::setFailureThreshold(uint8_t failures) {
+  _failureThreshold = failures<BH1750_BREAKER_MAX_THRESHOLD ? failures : BH1750_BREAKER_MAX_THRESHOLD;
+}
+
+/**
+ * Verified transfers (all sensors).
+ */
+void AS_BH1750Core::setBusVerification(bool verify) {
+  _verify = verify;
+}
+
+/**
+ * Relative resolution target of the automatic mode in per mille (0: off).
+ */
+void AS_BH1750Core::setResolutionTarget(uint8_t permille) {
+  _resolutionTarget = permille;
+}
+
+/**
+ * Pins of the I2C bus for the bus clear (255: no bus clear).
+ */
+void AS_BH1750Core::setBusClearPins(uint8_t sda, uint8_t scl) {
+  _sdaPin = sda;
+  _sclPin = scl;
+}
+
+/**
+ * Copies the transition counters of the circuit breaker.
+ */
+void AS_BH1750Core::getBreakerStats(bh1750_breaker_stats_t* stats) {
+  *stats = _breakerStats;
+}
+
+/**
+ * Complete measurement with the given delay function (blocking loop over the stage machine).
+ * Fills the measurement record. With a time function, the start of the integration is the time
+ * of the mode command that started the conversion, otherwise (continuous mode, warm start)
+ * the time of the read minus the typical measurement time. Failed measurements: start = end.
+ */
+void AS_BH1750Core::measure(DelayFuncPtr fDelayPtr, bh1750_measurement_t* m, TimeFuncPtr fTimePtr, EstimateFuncPtr fEstimatePtr) {
+  bh1750_job_t job;
+  job.stage = BH1750_STAGE_START;
+  job.triggered = false;
+  unsigned long start = 0;
+  for(;;) {
+    bool triggered = job.triggered;
+    uint8_t stage = job.stage;
+    bool running = step(job);
+    // time stamp of the mode command, without it of the read
+    if(fTimePtr!=NULL && (job.triggered ? !triggered : !running)) {
+      start = fTimePtr();
+    }
+    if(!running) {
+      break;
+    }
+    if(fEstimatePtr!=NULL && stage==BH1750_STAGE_RANGE && job.stage==BH1750_STAGE_MEASURE) {
+      // probe done, the actual measurement is running
+      fEstimatePtr(bh1750Lux(job.estimate, BH1750_MTREG_DEFAULT, BH1750_CONTINUOUS_LOW_RES_MODE));
+    }
+    fDelayPtr(job.wait);
+  }
+  describe(job, m);
+  unsigned long duration = (fTimePtr!=NULL && job.stage==BH1750_STAGE_DONE) ? getModeDelay() : 0;
+  m->start = job.triggered ? start : start - duration;
+  m->end = m->start + duration;
+}
+
+/**
+ * Complete measurement without conversion (raw value with MTreg and hardware mode).
+ */
+bool AS_BH1750Core::measureRaw(DelayFuncPtr fDelayPtr, bh1750_record_t* r) {
+  bh1750_job_t job;
+  job.stage = BH1750_STAGE_START;
+  while(step(job)) {
+    fDelayPtr(job.wait);
+  }
+  return record(job, r);
+}
+
+/**
+ * Fills the raw record of a job. Returns true if the job has finished successfully.
+ */
+bool AS_BH1750Core::record(const bh1750_job_t& job, bh1750_record_t* r) {
+  bool done = job.stage==BH1750_STAGE_DONE;
+  r->raw = done ? job.raw : 0;
+  r->MTreg = _MTreg;
+  r->mode = _hardwareMode;
+  return done;
+}
+
+/**
+ * Fills the measurement record of a finished (or running) job, without start and end.
+ * The lux value of an unsuccessful measurement is the error value of readLightLevel.
+ */
+void AS_BH1750Core::describe(const bh1750_job_t& job, bh1750_measurement_t* m) {
+  m->raw = job.stage==BH1750_STAGE_DONE ? job.raw : 0;
+  m->MTreg = _MTreg;
+  m->mode = _hardwareMode;
+  switch (job.stage) {
+  case BH1750_STAGE_DONE:
+    m->status = BH1750_MEASUREMENT_VALID | (job.raw==65535 ? BH1750_MEASUREMENT_SATURATED : 0);
+    m->lux = convertRawValue(job.raw);
+    break;
+  case BH1750_STAGE_TIMEOUT:
+    m->status = BH1750_MEASUREMENT_TIMEOUT;
+    m->lux = BH1750_TIMEOUT;
+    break;
+  case BH1750_STAGE_ERROR:
+  case BH1750_STAGE_IDLE:
+    m->status = BH1750_MEASUREMENT_ERROR;
+    m->lux = -1;
+    break;
+  case BH1750_STAGE_MEASURE:
+    if(virtualMode()==RESOLUTION_AUTO_HIGH) {
+      // the automatic mode reaches the measurement only via the probe: its value is the estimate
+      m->raw = job.estimate;
+      m->MTreg = BH1750_MTREG_DEFAULT;
+      m->mode = BH1750_CONTINUOUS_LOW_RES_MODE;
+      m->status = BH1750_MEASUREMENT_RUNNING | BH1750_MEASUREMENT_ESTIMATE | (job.estimate==65535 ? BH1750_MEASUREMENT_SATURATED : 0);
+      m->lux = bh1750Lux(job.estimate, BH1750_MTREG_DEFAULT, BH1750_CONTINUOUS_LOW_RES_MODE);
+      break;
+    }
+    // fall through
+  default:
+    m->status = BH1750_MEASUREMENT_RUNNING;
+    m->lux = -100;
+    break;
+  }
+}
+
+/**
+ * Determines MTreg and hardware mode of the automatic mode for the level read in LowResMode.
+ */
+void AS_BH1750Core::autoRange(uint16_t level, uint8_t& mtreg, uint8_t& mode) {
+  if(level<10) {
+#if BH1750_DEBUG == 1
+    Serial.println("level 0: dark");
+#endif    
+    // Dark, sensitivity to maximum.
+    // The value is random. From about 16000 this approach would be possible.
+    // I need this accuracy but only in the dark areas (to see when really 'dark').
+    mtreg = flickerMTReg(BH1750_MTREG_MAX, false);
+    mode = _autoPowerDown?BH1750_ONE_TIME_HIGH_RES_MODE_2:BH1750_CONTINUOUS_HIGH_RES_MODE_2;
+  }
+  else if(level<32767) {
+#if BH1750_DEBUG == 1
+    Serial.println("level 1: normal");
+#endif    
+    // Up to this point, the 0.5 lx mode is enough. Normal sensitivity.
+    mtreg = flickerMTReg(BH1750_MTREG_DEFAULT, false);
+    mode = _autoPowerDown?BH1750_ONE_TIME_HIGH_RES_MODE_2:BH1750_CONTINUOUS_HIGH_RES_MODE_2;
+  } 
+  else if(level<60000) {
+#if BH1750_DEBUG == 1
+    Serial.println("level 2: bright");
+#endif    
+    // high range, 1 lx mode, normal sensitivity. The value of 60000 is more or less random, it simply needs to be a high value, close to the limit.
+    mtreg = flickerMTReg(BH1750_MTREG_DEFAULT, false);
+    mode = _autoPowerDown?BH1750_ONE_TIME_HIGH_RES_MODE:BH1750_CONTINUOUS_HIGH_RES_MODE;
+  }
+  else {
+#if BH1750_DEBUG == 1
+    Serial.println("level 3: very bright");
+#endif    
+    // very high range, reduce sensitivity
+    mtreg = flickerMTReg(32, false); // Min+1, at the minimum from Doku the sensor (at least my) is crazy: The values are about 1/10 of the expected.
+    mode = _autoPowerDown?BH1750_ONE_TIME_HIGH_RES_MODE:BH1750_CONTINUOUS_HIGH_RES_MODE;
+  }
+}
+
+/**
+ * Read the raw value of the brightness.
+ * Range of values 0-65535.
+ * With verification (setBusVerification), the value is read twice; if the readings differ
+ * (corrupted, or a new conversion in between in continuous mode), a third reading must match one of them.
+ * Returns false on a bus error (NACK, short read, timeout) or a failed verification; 65535 is then a valid (saturated) value.
+ */
+bool AS_BH1750Core::readRawLevel(uint16_t& level) {
+  if(!readData(level)) {
+    return false;
+  }
+  if(_verify) {
+    uint16_t again;
+    if(!readData(again)) {
+      return false;
+    }
+    if(again!=level) {
+      uint16_t third;
+      if(!readData(third) || (third!=level && third!=again)) {
+#if BH1750_DEBUG == 1
+        Serial.println("I2C read verification failed");
+#endif
+        return false;
+      }
+      level = third;
+    }
+  }
+
+#if BH1750_DEBUG == 1
+  Serial.print("Raw light level: ");
+  Serial.println(level);
+#endif
+
+  _valueReaded=true;
+  setLastRaw(level);
+
+  return true;
+}
+
+/**
+ * One reading of the data register (one bus transaction).
+ */
+bool AS_BH1750Core::readData(uint16_t& level) {
+  BH1750_WIRE.beginTransmission(_address);
+  uint8_t received = BH1750_WIRE.requestFrom((int)_address, 2);
+#if (ARDUINO >= 100)
+  level = BH1750_WIRE.read();
+  level <<= 8;
+  level |= BH1750_WIRE.read();
+#else
+  level = BH1750_WIRE.receive();
+  level <<= 8;
+  level |= BH1750_WIRE.receive();
+#endif
+  if(!endTransmission() || received!=2) {
+#if BH1750_DEBUG == 1
+    Serial.println("I2C read error");
+#endif
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Convert raw values to lux.
+ */
+float AS_BH1750Core::convertRawValue(uint16_t raw) {
+  // Conversion incl. MTreg influence: lux per count from the table (fixed point),
+  // half of it in the H-resolution mode 2 (see AS_BH1750Tables.h)
+  float flevel = bh1750Lux(raw, _MTreg, _hardwareMode);
+
+#if BH1750_DEBUG == 1
+  Serial.print("Light level: ");
+  Serial.println(flevel);
+#endif
+
+  return flevel;
+}
+
+/**
+ * MTreg. Defines sensor sensitivity.
+ * Min.value (BH1750_MTREG_MIN) = 31 (Sensitivity: default * 0.45)
+ * Max.value (BH1750_MTREG_MAX) = 254 (Sensitivity: default * 3.68)
+ * Default (BH1750_MTREG_DEFAULT) = 69.
+ * The sensitivity changes the reading time (higher sensitivity means longer period of time).
+ * Returns false on a bus error (the next wake-up transmits the value again).
+ */
+bool AS_BH1750Core::defineMTReg(uint8_t val) {
+  if(val<BH1750_MTREG_MIN) {
+    val = BH1750_MTREG_MIN;
+  }
+  if(val>BH1750_MTREG_MAX) {
+    val = BH1750_MTREG_MAX;
+  }
+  if(val!=_MTreg) {
+    _MTreg = val;
+
+    // Change Measurement time
+    // Transmission in two steps: 3 bits and 5 bits, each with a prefix.
+    //   High bit: 01000_MT[7,6,5]
+    //   Low bit:  011_MT[4,3,2,1,0]
+    uint8_t hiByte = val>>5;
+    hiByte |= 0b01000000;
+#if BH1750_DEBUG == 1
+    Serial.print("MGTreg high byte: ");
+    Serial.println(hiByte, BIN);
+#endif
+    if(!write8(hiByte)) {
+      _wakeUp = true;
+      return false;
+    }
+    //fDelayPtr(10);
+    // Pause necessary?
+    uint8_t loByte = val&0b00011111;
+    loByte |= 0b01100000;
+#if BH1750_DEBUG == 1
+    Serial.print("MGTreg low byte: ");
+    Serial.println(loByte, BIN);
+#endif
+    if(!write8(loByte)) {
+      _wakeUp = true;
+      return false;
+    }
+    //fDelayPtr(10);
+  }
+  return true;
+}
+
+/**
+ * Restores hardware mode and MTreg after a measurement in another mode (readPlanned, capture, accumulate).
+ * A continuous mode is started again. A one-time mode is only noted and the sensor is powered down:
+ * its mode command would start a conversion, the next measurement sends it (wake-up).
+ */
+bool AS_BH1750Core::restoreMode(uint8_t mode, uint8_t mtreg) {
+  bool ok = defineMTReg(mtreg);
+  if((mode&0xF0)==BH1750_ONE_TIME_HIGH_RES_MODE) {
+    _hardwareMode = mode;
+    _valueReaded = true;
+    return write8(BH1750_POWER_DOWN) && ok;
+  }
+  return selectResolutionMode(mode) && ok;
+}
+
+/**
+ * Indicates whether the sensor is initialized.
+ */
+bool AS_BH1750Core::isInitialized() {
+  return _hardwareMode!=BH1750_NO_MODE; 
+}
+
+/**
+ * Virtual mode (stored as 2-bit code: RESOLUTION_AUTO_HIGH as 0, the fixed modes as their value).
+ */
+sensors_resolution_t AS_BH1750Core::virtualMode(void) {
+  return _virtualCode==0 ? RESOLUTION_AUTO_HIGH : (sensors_resolution_t)_virtualCode;
+}
+
+void AS_BH1750Core::setVirtualMode(sensors_resolution_t mode) {
+  _virtualCode = (mode==RESOLUTION_LOW || mode==RESOLUTION_NORMAL || mode==RESOLUTION_HIGH) ? mode : 0;
+}
+
+/**
+ * Last raw value (stored as two bytes, so that the packed state needs no alignment).
+ */
+uint16_t AS_BH1750Core::lastRaw(void) {
+  return ((uint16_t)_lastRawHigh<<8) | _lastRawLow;
+}
+
+void AS_BH1750Core::setLastRaw(uint16_t raw) {
+  _lastRawHigh = raw>>8;
+  _lastRawLow = raw;
+}
+
+/**
+ * Write one byte to I2C bus (to the address of the sensor).
+ */
+bool AS_BH1750Core::write8(uint8_t d) {
+  BH1750_WIRE.beginTransmission(_address);
+#if (ARDUINO >= 100)
+  BH1750_WIRE.write(d);
+#else
+  BH1750_WIRE.send(d);
+#endif
+  return endTransmission();
+}
+
+
+
+/**
+ * Sets the frequency of the light flicker (100 Hz at 50 Hz mains, 120 Hz at 60 Hz mains, 0 = off).
+ * With an active flicker frequency, only MTreg values are used whose measurement time
+ * is a whole number of flicker periods, so that a single measurement is free of flicker.
+ */
+void AS_BH1750Core::setFlickerFrequency(uint8_t frequency) {
+  setFlickerCode(frequency);
+  if(isInitialized() && virtualMode()!=RESOLUTION_AUTO_HIGH) {
+    // fixed modes: apply the new measurement time directly
+    restoreMode(_hardwareMode, flickerMTReg(BH1750_MTREG_DEFAULT, virtualMode()==RESOLUTION_LOW));
+  }
+}
+
+/**
+ * Returns the flicker frequency in use (0 = off).
+ */
+uint8_t AS_BH1750Core::getFlickerFrequency(void) {
+  return _flicker==1 ? 100 : (_flicker==2 ? 120 : 0);
+}
+
+/**
+ * Stores the flicker frequency as 2-bit code (the mains frequency 50/60 Hz is also accepted).
+ */
+void AS_BH1750Core::setFlickerCode(uint8_t frequency) {
+  switch (frequency) {
+  case 50:
+  case 100:
+    _flicker = 1;
+    break;
+  case 60:
+  case 120:
+    _flicker = 2;
+    break;
+  default:
+    _flicker = 0;
+    break;
+  }
+}
+
+/**
+ * Detects light flicker of 100 Hz or 120 Hz.
+ * In the L-resolution mode, a series of fast measurements is carried out with two measurement times:
+ * approx. 10 ms (whole period at 100 Hz) and approx. 8.3 ms (whole period at 120 Hz).
+ * The series whose measurement time matches the flicker remains stable, the other fluctuates.
+ * The detected frequency is used for all further measurements (see setFlickerFrequency).
+ * Returns the detected frequency or 0 (no flicker, or too dark to detect).
+ * Takes approx. 200 ms.
+ */
+uint8_t AS_BH1750Core::detectFlicker(DelayFuncPtr fDelayPtr) {
+  if(!isInitialized()) {
+    return 0;
+  }
+
+  // 10 ms and 8.33 ms in L-resolution: MTreg 43 (9.97 ms) and MTreg 36 (8.35 ms)
+  uint16_t spread100 = flickerSpread(43, fDelayPtr);
+  uint16_t spread120 = flickerSpread(36, fDelayPtr);
+#if BH1750_DEBUG == 1
+  Serial.print("flicker spread 100Hz/120Hz: ");
+  Serial.print(spread100);
+  Serial.print(" / ");
+  Serial.println(spread120);
+#endif
+
+  // The mismatched measurement time must fluctuate clearly more than the matching one
+  // (some L-resolution steps of 4 counts as tolerance).
+  uint8_t frequency = 0;
+  if(spread120>2*spread100+8) {
+    frequency = 100;
+  }
+  else if(spread100>2*spread120+8) {
+    frequency = 120;
+  }
+
+  // restore previous mode (with the new measurement time)
+  setFlickerFrequency(frequency);
+  if(virtualMode()==RESOLUTION_AUTO_HIGH && _autoPowerDown) {
+    powerDown();
+  }
+  return frequency;
+}
+
+/**
+ * Fluctuation (max - min of the raw values) of a series of measurements
+ * in continuous L-resolution mode with the given MTreg.
+ */
+uint16_t AS_BH1750Core::flickerSpread(uint8_t mtreg, DelayFuncPtr fDelayPtr) {
+  uint8_t mode = _hardwareMode;
+  defineMTReg(mtreg);
+  selectResolutionMode(BH1750_CONTINUOUS_LOW_RES_MODE);
+  fDelayPtr(BH1750_SETTLE_TIME+10); // first measurement
+  uint16_t min = 65535;
+  uint16_t max = 0;
+  for(uint8_t i=0; i<8; i++) {
+    fDelayPtr(10); // > measurement time, each value comes from a new measurement
+    uint16_t level;
+    if(!readRawLevel(level)) {
+      continue;
+    }
+    if(level<min) {
+      min = level;
+    }
+    if(level>max) {
+      max = level;
+    }
+  }
+  _hardwareMode = mode;
+  return max>=min ? max-min : 0; // 0: no value read
+}
+
+/**
+ * Returns the MTreg value to be used instead of the desired one.
+ * Without flicker frequency, this is the desired value.
+ * Otherwise, the MTreg whose measurement time is closest to the nearest whole number of flicker periods
+ * (at least one) of the desired measurement time, within the MTreg range.
+ * Measurement time: 120 ms (H-resolution) or 16 ms (L-resolution) at MTreg 69, proportional to MTreg.
+ */
+uint8_t AS_BH1750Core::flickerMTReg(uint8_t mtreg, bool lowRes) {
+  uint8_t frequency = getFlickerFrequency();
+  if(frequency==0) {
+    return mtreg;
+  }
+  // periods = time[ms] * f / 1000 = base * m * f / (69 * 1000), one period is d / (base * f) MTreg
+  uint32_t base = lowRes?16:120;
+  uint32_t d = 69000UL;
+  uint32_t step = base * frequency;
+  uint32_t periods = (base * mtreg * frequency + d/2) / d;
+  if(periods<1) {
+    periods = 1;
+  }
+  uint32_t m = (periods * d + step/2) / step;
+  // the nearest multiple outside the MTreg range: the next one inside
+  while(m>BH1750_MTREG_MAX && periods>1) {
+    periods--;
+    m = (periods * d + step/2) / step;
+  }
+  while(m<BH1750_MTREG_MIN) {
+    periods++;
+    m = (periods * d + step/2) / step;
+  }
+  return m>BH1750_MTREG_MAX ? BH1750_MTREG_MAX : m;
+}
+
+/**
+ * Typical measurement time of the current hardware mode with the current MTreg (ms):
+ * 120 ms (H-resolution) or 16 ms (L-resolution) at MTreg 69, proportional to MTreg.
+ */
+unsigned long AS_BH1750Core::getModeDelay() {
+  switch (_hardwareMode) {
+  case BH1750_CONTINUOUS_HIGH_RES_MODE:
+  case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+  case BH1750_ONE_TIME_HIGH_RES_MODE:
+  case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+    return bh1750MeasurementTime(_MTreg, false);
+
+  case BH1750_CONTINUOUS_LOW_RES_MODE:
+  case BH1750_ONE_TIME_LOW_RES_MODE:
+    return bh1750MeasurementTime(_MTreg, true);
+
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Fast capture of a waveform.
+ * Continuous L-resolution mode with minimum MTreg, raw values on a fixed schedule.
+ */
+bool AS_BH1750Core::capture(uint16_t* raw, unsigned long* timestamps, uint16_t count, unsigned long interval,
+    bh1750_capture_t* result, TimeFuncPtr fTimePtr) {
+  if(!isInitialized() || count==0) {
+    return false;
+  }
+
+  uint8_t mode = _hardwareMode;
+  uint8_t mtreg = _MTreg;
+  defineMTReg(BH1750_MTREG_MIN);
+  selectResolutionMode(BH1750_CONTINUOUS_LOW_RES_MODE);
+
+  unsigned long first = 0;
+  unsigned long last = 0;
+  unsigned long jitter = 0;
+  uint16_t n = 0;
+  // first measurement must be complete
+  unsigned long start = fTimePtr() + (BH1750_SETTLE_TIME+getModeDelay())*1000UL;
+  for(; n<count; n++) {
+    unsigned long scheduled = start + n*interval;
+    while((long)(fTimePtr()-scheduled)<0) {
+      // wait for the next point in time
+    }
+    unsigned long t = fTimePtr();
+    if(!readRawFast(raw[n])) {
+      break;
+    }
+    if(timestamps!=NULL) {
+      timestamps[n] = t;
+    }
+    if(n==0) {
+      first = t;
+    }
+    last = t;
+    if(t-scheduled>jitter) {
+      jitter = t-scheduled;
+    }
+  }
+
+  if(result!=NULL) {
+    result->samples = n;
+    result->duration = last-first;
+    result->sampleRate = (n>1 && last>first) ? (n-1)*1000000.0/(last-first) : 0;
+    result->jitter = jitter;
+    result->luxPerCount = convertRawValue(1);
+  }
+
+  restoreMode(mode, mtreg);
+  return n==count;
+}
+
+/**
+ * Plans the fastest measurement for a target standard error at the light level of the last measurement.
+ */
+bool AS_BH1750Core::plan(float error, bool relative, bh1750_plan_t* plan) {
+  float lux = (_MTreg>=BH1750_MTREG_MIN && _MTreg<=BH1750_MTREG_MAX) ? bh1750Lux(lastRaw(), _MTreg, _hardwareMode) : 0;
+  return planFor(lux, relative ? error*lux : error, plan);
+}
+
+/**
+ * Plans the fastest measurement for a target standard error (lux) at the given light level.
+ * Evaluates every continuous hardware mode and MTreg: the samples needed follow from the
+ * standard error of one sample, the time from the measurement time of the setting.
+ */
+bool AS_BH1750Core::planFor(float lux, float error, bh1750_plan_t* plan) {
+  const uint8_t modes[] = { BH1750_CONTINUOUS_LOW_RES_MODE, BH1750_CONTINUOUS_HIGH_RES_MODE, BH1750_CONTINUOUS_HIGH_RES_MODE_2 };
+  bool found = false;
+  float bestError = -1;
+  for(uint8_t m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+    bool lowRes = modes[m]==BH1750_CONTINUOUS_LOW_RES_MODE;
+    float step = lowRes ? BH1750_PROBE_STEP : 1;
+    float countNoise = sqrt(step*step/12 + BH1750_NOISE_COUNTS*BH1750_NOISE_COUNTS);
+    for(uint16_t mtreg=BH1750_MTREG_MIN; mtreg<=BH1750_MTREG_MAX; mtreg++) {
+      float luxPerCount = bh1750Lux(1, mtreg, modes[m]);
+      if(lux/luxPerCount>BH1750_PLAN_MAX_COUNTS) {
+        continue; // out of range
+      }
+      float sigma = countNoise * luxPerCount;
+      // samples needed: sigma / sqrt(n) <= error
+      float needed = error>0 ? (sigma/error)*(sigma/error) : BH1750_PLAN_MAX_SAMPLES+1;
+      uint8_t samples = needed<=1 ? 1 : (needed>BH1750_PLAN_MAX_SAMPLES ? BH1750_PLAN_MAX_SAMPLES : (uint8_t)ceil(needed));
+      float expected = sigma / sqrt((float)samples);
+      bool reached = expected<=error;
+      uint16_t time = BH1750_SETTLE_TIME + samples * bh1750MeasurementTime(mtreg, lowRes);
+      // reached: the fastest (at equal time the more precise) plan, otherwise the most precise
+      bool better = reached ? (!found || time<plan->time || (time==plan->time && expected<plan->error))
+        : (!found && (bestError<0 || expected<bestError));
+      if(better) {
+        found = found || reached;
+        bestError = expected;
+        plan->error = expected;
+        plan->time = time;
+        plan->mode = modes[m];
+        plan->MTreg = mtreg;
+        plan->samples = samples;
+      }
+    }
+  }
+  if(bestError<0) {
+    // brighter than every range: least sensitive setting
+    plan->mode = BH1750_CONTINUOUS_HIGH_RES_MODE;
+    plan->MTreg = BH1750_MTREG_MIN;
+    plan->samples = 1;
+    plan->time = BH1750_SETTLE_TIME + bh1750MeasurementTime(BH1750_MTREG_MIN, false);
+    plan->error = sqrt(1.0f/12 + BH1750_NOISE_COUNTS*BH1750_NOISE_COUNTS) * bh1750Lux(1, BH1750_MTREG_MIN, plan->mode);
+  }
+  return found;
+}
+
+/**
+ * Carries out a plan: averages its samples in continuous mode, restores the previous mode.
+ */
+float AS_BH1750Core::readPlanned(const bh1750_plan_t* plan, DelayFuncPtr fDelayPtr) {
+  if(!isInitialized() || plan->samples==0 || plan->MTreg<BH1750_MTREG_MIN || plan->MTreg>BH1750_MTREG_MAX) {
+    return -1;
+  }
+  uint8_t mode = _hardwareMode;
+  uint8_t mtreg = _MTreg;
+  uint32_t sum = 0;
+  bool ok = defineMTReg(plan->MTreg) && selectResolutionMode(plan->mode);
+  if(ok) {
+    // first measurement must be complete, then one sample per measurement time
+    fDelayPtr(BH1750_SETTLE_TIME + getModeDelay());
+    for(uint8_t i=0; i<plan->samples && ok; i++) {
+      uint16_t raw;
+      if(i>0) {
+        fDelayPtr(getModeDelay());
+      }
+      ok = readRawLevel(raw);
+      if(ok) {
+        sum += raw;
+      }
+    }
+  }
+  float lux = sum * bh1750Lux(1, plan->MTreg, plan->mode) / plan->samples;
+
+  restoreMode(mode, mtreg);
+  return ok ? lux : -1;
+}
+
+/**
+ * Low-light accumulation: back-to-back integrations in continuous H-resolution mode 2 with MTreg 254.
+ * The data register is cleared with the reset command (the running integration continues) and read
+ * every BH1750_ACCUMULATE_POLL ms: a value other than 0 marks the end of an integration, the register
+ * is cleared again right after it. So each integration is accumulated once, whatever the clock
+ * of the sensor, and the ends give the real period. Integrations that stay at 0 (darkness) show no end,
+ * they are counted from the period. If more than one integration ends between two readings
+ * (the delay function overran a period), the earlier ones are lost and counted as missed.
+ * The spread of the readings (Welford) gives the standard error of the mean.
+ * Readings that do not spread by the quantisation (1/sqrt(12) count) are not dithered,
+ * so that part of the quantisation is not reduced by the accumulation.
+ */
+bool AS_BH1750Core::accumulate(uint16_t count, bh1750_accumulation_t* result, DelayFuncPtr fDelayPtr, TimeFuncPtr fTimePtr) {
+  result->sum = 0;
+  result->samples = 0;
+  result->observed = 0;
+  result->missed = 0;
+  result->period = BH1750_ACCUMULATE_PERIOD;
+  result->duration = 0;
+  result->lux = 0;
+  result->resolution = 0;
+  result->error = 0;
+  if(!isInitialized() || count==0) {
+    return false;
+  }
+
+  uint8_t mode = _hardwareMode;
+  uint8_t mtreg = _MTreg;
+  unsigned long start = fTimePtr();
+  bool ok = defineMTReg(BH1750_MTREG_MAX) && selectResolutionMode(BH1750_CONTINUOUS_HIGH_RES_MODE_2) && write8(BH1750_RESET);
+  // last seen end (at first the start of the first integration), first seen end and integrations since
+  unsigned long last = start;
+  unsigned long first = start;
+  uint16_t since = 0;
+  unsigned long polled = start;
+  float mean = 0;
+  float m2 = 0;
+  while(ok && result->samples<count) {
+    fDelayPtr(BH1750_ACCUMULATE_POLL);
+    uint16_t raw;
+    ok = readRawLevel(raw);
+    unsigned long now = fTimePtr();
+    unsigned long period = result->period;
+    uint16_t missing = count - result->samples;
+    // integrations at 0 that ended before the previous reading
+    uint16_t zeros = (polled-last) / period;
+    bool seen = ok && raw!=0;
+    if(seen) {
+      // end of an integration: clear the register long before the next one ends
+      ok = write8(BH1750_RESET);
+      uint16_t ended = (now-last+period/2) / period;
+      if(ended<1 || (result->observed==0 && now-last<2*BH1750_ACCUMULATE_PERIOD)) {
+        // the first end: the sensor clock may be up to 50% slower than typical
+        ended = 1;
+      }
+      if(zeros>ended-1) {
+        zeros = ended-1;
+      }
+      result->missed += ended-1-zeros;
+      if(zeros>missing-1) {
+        zeros = missing-1;
+      }
+      // the period from the seen ends (resynchronised on each of them)
+      if(result->observed==0) {
+        first = now;
+        if(ended==1) {
+          result->period = now-start;
+        }
+      } else {
+        since += ended;
+        result->period = (now-first) / since;
+      }
+      result->observed++;
+      last = now;
+    } else if(ok && now-last>=period/2 && (now-last-period/2)/period>=missing) {
+      // no end seen: the remaining integrations ended at 0
+      zeros = missing;
+    } else {
+      zeros = 0;
+    }
+    polled = now;
+
+    // integrations at 0, then the seen one
+    uint16_t values = zeros + (seen ? 1 : 0);
+    for(uint16_t i=0; i<values; i++) {
+      uint16_t value = i<zeros ? 0 : raw;
+      result->sum += value;
+      result->samples++;
+      float delta = value - mean;
+      mean += delta / result->samples;
+      m2 += delta * (value - mean);
+    }
+  }
+
+  restoreMode(mode, mtreg);
+
+  uint16_t n = result->samples;
+  if(n>0) {
+    float luxPerCount = bh1750Lux(1, BH1750_MTREG_MAX, BH1750_CONTINUOUS_HIGH_RES_MODE_2);
+    float variance = n>1 ? m2 / (n-1) : 0;
+    // undithered part of the quantisation (variance of 1 count: 1/12)
+    float undithered = variance*12<1 ? (1 - variance*12) / 12 : 0;
+    result->duration = (unsigned long)n * (result->period/100) / 10;
+    result->resolution = luxPerCount / n;
+    // the sensor truncates: each reading is half a count low on average
+    result->lux = (result->sum + 0.5f*n) * result->resolution;
+    result->error = sqrt(variance / n + undithered) * luxPerCount;
+  }
+  return ok;
+}
+
+/**
+ * Reads the raw value with a single bus transaction (without checks and conversion).
+ */
+bool AS_BH1750Core::readRawFast(uint16_t& raw) {
+  if(BH1750_WIRE.requestFrom((int)_address, 2)!=2) {
+#ifdef WIRE_HAS_TIMEOUT
+    if(BH1750_WIRE.getWireTimeoutFlag()) {
+      _timedOut = true;
+      BH1750_WIRE.clearWireTimeoutFlag();
+    }
+#endif
+    return false;
+  }
+#if (ARDUINO >= 100)
+  raw = BH1750_WIRE.read();
+  raw <<= 8;
+  raw |= BH1750_WIRE.read();
+#else
+  raw = BH1750_WIRE.receive();
+  raw <<= 8;
+  raw |= BH1750_WIRE.receive();
+#endif
+  return true;
+}
+
+/**
+ * Saves the learned state (range, MTreg, flicker frequency, last raw value)
+ * into a small, versioned and CRC-protected block.
+ * The application can store it (e.g. in EEPROM or flash) and pass it to begin() after a restart.
+ */
+void AS_BH1750Core::saveState(bh1750_state_t* state) {
+  state->version = BH1750_STATE_VERSION;
+  state->virtualMode = virtualMode();
+  state->hardwareMode = _hardwareMode;
+  state->MTreg = _MTreg;
+  state->autoPowerDown = _autoPowerDown;
+  state->flickerFrequency = getFlickerFrequency();
+  state->lastRaw = lastRaw();
+  state->crc = stateCRC(state);
+}
+
+/**
+ * Checks version, CRC and value ranges of a saved state.
+ */
+bool AS_BH1750Core::checkState(const bh1750_state_t* state) {
+  if(state->version!=BH1750_STATE_VERSION || state->crc!=stateCRC(state)) {
+    return false;
+  }
+  if(state->MTreg<BH1750_MTREG_MIN || state->MTreg>BH1750_MTREG_MAX) {
+    return false;
+  }
+  switch (state->hardwareMode) {
+  case BH1750_CONTINUOUS_HIGH_RES_MODE:
+  case BH1750_CONTINUOUS_HIGH_RES_MODE_2:
+  case BH1750_CONTINUOUS_LOW_RES_MODE:
+  case BH1750_ONE_TIME_HIGH_RES_MODE:
+  case BH1750_ONE_TIME_HIGH_RES_MODE_2:
+  case BH1750_ONE_TIME_LOW_RES_MODE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * CRC-8 (polynomial 0x31, init 0xFF) over the state without the CRC byte.
+ */
+uint8_t AS_BH1750Core::stateCRC(const bh1750_state_t* state) {
+  const uint8_t* data = (const uint8_t*)state;
+  uint8_t crc = 0xFF;
+  for(uint8_t i=0; i<offsetof(bh1750_state_t, crc); i++) {
+    crc ^= data[i];
+    for(uint8_t b=0; b<8; b++) {
+      crc = (crc&0x80) ? (crc<<1)^0x31 : (crc<<1);
+    }
+  }
+  return crc;
+}
+
+/**
+ * Resumes operation after a deep sleep (the driver object was rebuilt, the sensor remained powered).
+ * Trusts the saved state (e.g. kept in RTC memory): no bus initialization (Wire.begin() is up to the application),
+ * no MTreg transmission and no settling pause. Only the measurement in the saved mode is triggered,
+ * the next readLightLevel() waits for its completion.
+ * Returns false if the state is invalid (then begin() must be used).
+ */
+bool AS_BH1750Core::resume(const bh1750_state_t* state) {
+  if(!checkState(state)) {
+    return false;
+  }
+  setVirtualMode((sensors_resolution_t)state->virtualMode);
+  _autoPowerDown = state->autoPowerDown;
+  setFlickerCode(state->flickerFrequency);
+  setLastRaw(state->lastRaw);
+  _MTreg = state->MTreg; // still set in the sensor
+  _hardwareMode = state->hardwareMode;
+  if(virtualMode()==RESOLUTION_AUTO_HIGH && _autoPowerDown) {
+    // the probe mode may have been saved: measure in the one-time variant
+    _hardwareMode = (_hardwareMode&0x0F)|0x20;
+  }
+  _valueReaded = false;
+  _wakeUp = false;
+  _warm = write8(_hardwareMode);
+  if(!_warm) {
+    _hardwareMode = BH1750_NO_MODE;
+  }
+  return _warm;
+}
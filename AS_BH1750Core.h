@@ -0,0 +1,355 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Core_h
+#define AS_BH1750Core_h
+
+#include "AS_BH1750Defs.h"
+#include "AS_BH1750Tables.h"
+
+/**
+ * Common core of the BH1750 drivers (AS_BH1750: blocking, AS_BH1750A: asynchronous).
+ * Contains the sensor state, the bus access and the stage machine of a measurement.
+ * The drivers only add the clock policy: the blocking driver waits with a delay function,
+ * the asynchronous driver checks the elapsed time with a time function.
+ */
+class AS_BH1750Core {
+public:
+  /**
+   * Constructor.
+   * Allows to change the I2C address of the sensor.
+   * Default address: 0x23, alternative address: 0x5C.
+   * Constants are defined as: BH1750_DEFAULT_I2CADDR and BH1750_SECOND_I2CADDR.
+   * When not specified, the default address is used.
+   * To use the alternative address, the sensor pin 'ADR' of the chip must be set to VCC.
+   */
+  AS_BH1750Core(uint8_t address = BH1750_DEFAULT_I2CADDR);
+
+  /**
+   * Performs the first initialization of the sensor.
+   * Possible parameters:
+   * - Sensor resolution mode:
+   * - RESOLUTION_LOW: Physical sensor mode with 4 lx resolution. Measurement time approx. 16ms. Range 0-54612.
+   * - RESOLUTION_NORMAL: Physical sensor mode with 1 lx resolution. Measurement time approx. 120ms. Range 0-54612.
+   * - RESOLUTION_HIGH: Physical sensor mode with 0.5 lx resolution. Measurement time approx. 120ms. Range 0-54612.
+   * (The measuring ranges can be moved by changing the MTreg.)
+   * - RESOLUTION_AUTO_HIGH: The values in the MTreg are automatically adjusted according to the brightness,
+   * that a maximum resolution and measuring range are achieved.
+   * The measurable values range from 0.11 lx to 100,000 lx.
+   * (I do not know how accurate the values are in border areas,
+   * especially with high values I have my doubts.
+   * However, the values seem to grow largely linearly with the increasing brightness.)
+   * Resolution in the lower range approximately 0.13 lx, in the middle 0.5 lx, in the upper approximately 1-2 lx.
+   * The measurement times are extended by multiple measurements and measurements
+   * the changes from Measurement Time (MTreg) to max. approx. 500 ms.
+   *
+   * - AutoPowerDown: true = The sensor is placed in the power saving mode after the measurement.
+   * The subsequent wake-up is performed automatically, but takes slightly more time.
+   *
+   * - state: learned state saved with saveState (e.g. in EEPROM) or NULL.
+   * If valid and saved for the same mode, the first measurement in RESOLUTION_AUTO_HIGH
+   * is carried out without probe in the last range (faster start after reset or deep sleep).
+   *
+   * Default values: RESOLUTION_AUTO_HIGH, true, NULL
+   *
+   */
+  bool begin(sensors_resolution_t mode = RESOLUTION_AUTO_HIGH, bool autoPowerDown = true, const bh1750_state_t* state = NULL);
+
+  /**
+   * Allow a check to see if a (responsive) BH1750 sensor is present.
+   */
+  bool isPresent(void);
+
+  /**
+   * Sends the sensor to power saving mode.
+   * Only works if the sensor has already been initialized.
+   */
+  void powerDown(void);
+
+  /**
+   * Detects light flicker of 100 Hz (50 Hz mains) or 120 Hz (60 Hz mains)
+   * and uses flicker-immune measurement times from then on.
+   * Returns the detected frequency or 0.
+   * Only works if the sensor has already been initialized. Takes approx. 200 ms.
+   */
+  uint8_t detectFlicker(DelayFuncPtr fDelayPtr = &delay);
+
+  /**
+   * Sets the flicker frequency (100, 120 or 0 = off).
+   * With an active flicker frequency, MTreg values are chosen whose measurement time
+   * is a whole number of flicker periods (the measured values are then free of flicker).
+   */
+  void setFlickerFrequency(uint8_t frequency);
+
+  /**
+   * Returns the flicker frequency in use (0 = off).
+   */
+  uint8_t getFlickerFrequency(void);
+
+  /**
+   * Fast capture of a waveform (e.g. for the analysis of lamp modulation).
+   * The sensor works in continuous L-resolution mode with minimum MTreg (measurement time approx. 7 ms).
+   * The raw values are read on a fixed schedule (every 'interval' us) into the given buffers,
+   * without conversion. Lux = raw * luxPerCount.
+   * Intervals shorter than the measurement time deliver repeated values.
+   * The previous mode is restored afterwards.
+   *
+   * - raw: buffer for 'count' raw values.
+   * - timestamps: buffer for 'count' timestamps (us) or NULL.
+   * - result: receives sample rate and jitter (or NULL).
+   * - TimeFuncPtr: micros() or own time function (us).
+   */
+  bool capture(uint16_t* raw, unsigned long* timestamps, uint16_t count, unsigned long interval,
+    bh1750_capture_t* result = NULL, TimeFuncPtr fTimePtr = &micros);
+
+  /**
+   * Plans the fastest measurement with a standard error of at most 'error' lux (relative = false)
+   * or 'error' as fraction of the reading (relative = true, e.g. 0.001), at the light level
+   * of the last measurement: hardware mode, MTreg and number of averaged continuous samples,
+   * with the expected standard error and completion time (see planFor).
+   * Returns false if the target cannot be reached; the plan is then the most precise one.
+   */
+  bool plan(float error, bool relative, bh1750_plan_t* plan);
+
+  /**
+   * Plans the fastest measurement with a standard error of at most 'error' lux at the light level 'lux'.
+   * Model per sample: quantisation (1 count, L-resolution 4 counts) and BH1750_NOISE_COUNTS,
+   * scaled with lux per count of mode and MTreg; n samples reduce it by sqrt(n).
+   * The light level must stay below BH1750_PLAN_MAX_COUNTS.
+   * Time: settling pause and n measurement times (continuous mode).
+   * Returns false if the target cannot be reached; the plan is then the most precise one.
+   */
+  static bool planFor(float lux, float error, bh1750_plan_t* plan);
+
+  /**
+   * Carries out a plan: sets mode and MTreg of the plan, averages its samples and restores
+   * the previous mode afterwards. Returns the light level, -1 if not initialized or on a bus error.
+   *
+   * Default values: delay ()
+   */
+  float readPlanned(const bh1750_plan_t* plan, DelayFuncPtr fDelayPtr = &delay);
+
+  /**
+   * Low-light accumulation beyond MTreg 254: the sensor integrates 'count' times back to back
+   * in continuous H-resolution mode 2 with MTreg 254 (approx. 442 ms each), the raw values are summed up.
+   * The data register is cleared after each integration and polled every BH1750_ACCUMULATE_POLL ms,
+   * so each integration is read once and no time is lost to re-triggering, even if the sensor clock
+   * deviates from the typical period (the measured period is returned). The resolution of the mean
+   * is 1/count of a single reading (approx. 0.11 lx), the standard error is estimated from the spread
+   * of the readings. The sensor truncates, so the mean is corrected by half a count (in darkness
+   * it is 0.5 counts, approx. 0.06 lx, with the error of the undithered quantisation).
+   * The previous mode is restored afterwards.
+   * Bus load: approx. 110 readings and one reset command per integration (more with setBusVerification).
+   * Limit: integrations that read 0 show no end; they are counted from the measured period,
+   * in complete darkness from the typical one: with a sensor clock deviating by d from it,
+   * count/(1+d) integrations (+-1) take place instead of count (datasheet: d up to +-50%),
+   * samples and duration are then off by that factor, the mean is not affected.
+   * Integrations lost because the delay function overran a period are counted in 'missed'.
+   * Returns false if not initialized, count is 0 or on a bus error (result holds the readings up to it).
+   *
+   * Default values: delay (), micros ()
+   */
+  bool accumulate(uint16_t count, bh1750_accumulation_t* result, DelayFuncPtr fDelayPtr = &delay, TimeFuncPtr fTimePtr = &micros);
+
+  /**
+   * Saves the learned state (range, MTreg, flicker frequency, last light level)
+   * into a versioned, CRC-protected block. It can be stored by the application
+   * (e.g. in EEPROM or flash) and passed to begin() after a restart.
+   */
+  void saveState(bh1750_state_t* state);
+
+  /**
+   * Fast restart after a deep sleep with a state saved by saveState (e.g. in RTC memory).
+   * Trusts the saved state: no Wire.begin() (must be done by the application), no MTreg transmission
+   * and no settling pause, only the measurement is triggered.
+   * The following measurement waits for this one.
+   * Returns false if the state is invalid (use begin() instead).
+   */
+  bool resume(const bh1750_state_t* state);
+
+  /**
+   * Indicates whether the circuit breaker of this sensor is open
+   * (too many consecutive failures: measurements fail fast without bus access).
+   */
+  bool isCircuitOpen(void);
+
+  /**
+   * Sets the number of consecutive failed measurements after which the circuit opens (all sensors).
+   * While open, measurements fail immediately (-1) without touching the bus. After a backoff
+   * (1, 2, 4, .. 64 skipped measurements) the next measurement is a recovery attempt:
+   * bus clear (see setBusClearPins), bus and sensor re-initialization, measurement.
+   * 0: the circuit never opens, at most BH1750_BREAKER_MAX_THRESHOLD (127). Default: BH1750_BREAKER_THRESHOLD.
+   */
+  static void setFailureThreshold(uint8_t failures);
+
+  /**
+   * Pins of the I2C bus for the bus clear (9 SCL pulses) before a recovery attempt (all sensors).
+   * Without pins (default), no bus clear takes place.
+   */
+  static void setBusClearPins(uint8_t sda, uint8_t scl);
+
+  /**
+   * Copies the transition counters of the circuit breaker (all sensors).
+   */
+  static void getBreakerStats(bh1750_breaker_stats_t* stats);
+
+  /**
+   * Time budget of one bus transaction in us (all sensors, 0: no timeout).
+   * Set by begin() on the bus, if the Wire library supports timeouts
+   * (AVR: setWireTimeout, ESP32: setTimeOut). A transaction on a stuck bus then fails
+   * after this time and the measurement returns BH1750_TIMEOUT instead of blocking forever.
+   * The measurement ends with the first failed transaction, so a call blocks at most one timeout.
+   * Timeouts count as failures of the circuit breaker: once it is open (see setFailureThreshold),
+   * measurements fail fast with -1 without bus access, recovery attempts return BH1750_TIMEOUT again.
+   * Note: the timeout applies to all devices on the bus.
+   * Default: BH1750_BUS_TIMEOUT.
+   */
+  static void setBusTimeout(unsigned long timeout);
+
+  /**
+   * Verified transfers (all sensors). The BH1750 has no checksum, so a flipped bit on the bus
+   * goes unnoticed: a corrupted read value, or a corrupted command that changes the MTreg
+   * of the sensor behind the back of the driver. With verification, the data register is
+   * read twice (a third reading decides if they differ, otherwise the measurement fails),
+   * the MTreg is sent again with every mode command, and the automatic mode stops the probe
+   * and clears the data register before the actual measurement, so a lost mode command reads 0
+   * instead of the probe and fails the measurement.
+   * Costs one reading per measurement, in one-time modes two MTreg commands,
+   * in the automatic mode five commands more.
+   * Default: false.
+   */
+  static void setBusVerification(bool verify);
+
+  /**
+   * Relative resolution target of RESOLUTION_AUTO_HIGH in per mille of the reading (all sensors, 0: off).
+   * If the quantisation of the probe (L-resolution, approx. 16 ms) already meets it, the probe value is
+   * the result and the actual measurement is skipped, e.g. 5 (0.5%): from approx. 670 lx on,
+   * bright readings take approx. 21 ms instead of 147 ms. A saturated probe is never sufficient.
+   * Default: 0 (always the actual measurement).
+   */
+  static void setResolutionTarget(uint8_t permille);
+
+  /**
+   * Raw value equivalent to a lux threshold for the MTreg and hardware mode in use
+   * (those of the last measurement, see readRaw): raw >= rawThreshold(t) exactly when
+   * the converted light level reaches t->lux. The value is cached in the threshold and
+   * only recomputed when the automatic mode has changed MTreg or mode, so threshold checks
+   * per measurement need no float arithmetic.
+   */
+  uint16_t rawThreshold(bh1750_threshold_t* t);
+
+protected:
+  /**
+   * Executes the next step of a measurement (stage machine).
+   * Start: job.stage = BH1750_STAGE_START. A measurement interrupted by powerDown() starts again.
+   * Returns true while the measurement is running: the next step is due after job.wait ms.
+   * Returns false when it is finished: BH1750_STAGE_DONE (raw value in job.raw), BH1750_STAGE_ERROR or BH1750_STAGE_TIMEOUT.
+   */
+  bool step(bh1750_job_t& job);
+
+  /**
+   * Complete measurement: runs the stage machine and waits with the given delay function.
+   * Fills the measurement record (light level in lux, -1 if not initialized or bus error, or BH1750_TIMEOUT).
+   * Start and end of the integration are only set with a time function (otherwise 0).
+   * In the automatic mode, the estimate of the probe is passed to fEstimatePtr (if given) before the actual measurement.
+   */
+  void measure(DelayFuncPtr fDelayPtr, bh1750_measurement_t* m, TimeFuncPtr fTimePtr = NULL, EstimateFuncPtr fEstimatePtr = NULL);
+
+  /**
+   * Fills the measurement record of a job (without start and end): raw value, MTreg, hardware mode, lux and status.
+   * While the actual measurement of the automatic mode is running: the probe with its estimate (BH1750_MEASUREMENT_ESTIMATE).
+   */
+  void describe(const bh1750_job_t& job, bh1750_measurement_t* m);
+
+  /**
+   * Complete measurement without conversion: raw value with MTreg and hardware mode.
+   * Returns false if not initialized or on a bus error.
+   */
+  bool measureRaw(DelayFuncPtr fDelayPtr, bh1750_record_t* r);
+
+  /**
+   * Fills the raw record of a job (raw value 0 unless finished successfully).
+   * Returns true if the job has finished successfully.
+   */
+  bool record(const bh1750_job_t& job, bh1750_record_t* r);
+
+  float convertRawValue(uint16_t raw);
+  unsigned long getModeDelay();
+
+private:
+  // Packed state (7 bytes per sensor, only byte fields: no alignment padding, see static_assert in AS_BH1750Core.cpp)
+  uint8_t _lastRawHigh;      // last raw value (see lastRaw())
+  uint8_t _lastRawLow;
+  uint8_t _address:7;        // 7-bit I2C address
+  uint8_t _wakeUp:1;         // the mode must be sent again (after powerDown() or a bus error)
+  uint8_t _hardwareMode:6;   // all hardware modes fit into 6 bits, BH1750_NO_MODE: not initialized
+  uint8_t _flicker:2;        // 0: off, 1: 100 Hz, 2: 120 Hz
+  uint8_t _MTreg;            // the scale factor is derived from it (see AS_BH1750Tables.h)
+  uint8_t _virtualCode:2;    // sensors_resolution_t, RESOLUTION_AUTO_HIGH as 0 (see virtualMode())
+  uint8_t _autoPowerDown:1;
+  uint8_t _valueReaded:1;
+  uint8_t _warm:1;
+  uint8_t _backoff:3;        // circuit breaker: 0: closed, otherwise open with this backoff level
+  uint8_t _health:7;         // closed: consecutive failures, open: measurements to skip
+  uint8_t _timedOut:1;       // a transaction of the current measurement of this sensor timed out
+
+  // Circuit breaker configuration and counters (shared by all sensors)
+  static uint8_t _failureThreshold;
+  static uint8_t _sdaPin;
+  static uint8_t _sclPin;
+  static bh1750_breaker_stats_t _breakerStats;
+  static unsigned long _busTimeout;
+  static uint8_t _resolutionTarget; // per mille, 0: off
+  static bool _verify;              // verified transfers
+
+  sensors_resolution_t virtualMode(void);
+  void setVirtualMode(sensors_resolution_t mode);
+  uint16_t lastRaw(void);
+  void setLastRaw(uint16_t raw);
+  bool selectResolutionMode(uint8_t mode);
+  bool defineMTReg(uint8_t val);
+  bool restoreMode(uint8_t mode, uint8_t mtreg);
+  bool powerOn(void);
+  bool readRawLevel(uint16_t& level);
+  bool readData(uint16_t& level);
+  bool isInitialized();
+  bool write8(uint8_t data);
+  uint8_t flickerMTReg(uint8_t mtreg, bool lowRes);
+  void setFlickerCode(uint8_t frequency);
+  uint16_t flickerSpread(uint8_t mtreg, DelayFuncPtr fDelayPtr);
+  bool readRawFast(uint16_t& raw);
+  void autoRange(uint16_t level, uint8_t& mtreg, uint8_t& mode);
+  bool checkState(const bh1750_state_t* state);
+  uint8_t stateCRC(const bh1750_state_t* state);
+  bool finish(bh1750_job_t& job, bool ok);
+  bool isAddressed(void);
+  bool endTransmission(void);
+  void beginBus(void);
+  void recover(void);
+  void busClear(void);
+};
+
+#endif
@@ -0,0 +1,296 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Defs_h
+#define AS_BH1750Defs_h
+
+#if (ARDUINO >= 100)
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+#include "Wire.h"
+
+/*
+ Definitions shared by all drivers (AS_BH1750, AS_BH1750A and their common core).
+ Defined only once, so that the drivers can be used side by side in one sketch.
+*/
+
+// I2C bus used by the driver (default: Wire).
+// Host builds (simulation, trace record/replay) can redirect all bus accesses
+// to any object offering the used subset of the Wire interface, e.g.:
+//   -DBH1750_WIRE=traceBus -DBH1750_WIRE_HEADER='"MyTraceBus.h"'
+#ifndef BH1750_WIRE
+#define BH1750_WIRE Wire
+#endif
+#ifdef BH1750_WIRE_HEADER
+#include BH1750_WIRE_HEADER
+#endif
+
+// Possible I2C addresses
+#define BH1750_DEFAULT_I2CADDR 0x23
+#define BH1750_SECOND_I2CADDR 0x5C
+
+// MTreg values
+// Default
+#define BH1750_MTREG_DEFAULT 69
+// Sensitivity : default = 0.45
+#define BH1750_MTREG_MIN 31
+// Sensitivity : default = 3.68
+#define BH1750_MTREG_MAX 254
+
+// Hardware Modes
+// No active state
+#define BH1750_POWER_DOWN 0x00
+
+// Wating for measurment command
+#define BH1750_POWER_ON 0x01
+
+// Reset data register value - not accepted in POWER_DOWN mode
+#define BH1750_RESET 0x07
+
+// Start measurement at 1lx resolution. Measurement time is approx 120ms.
+#define BH1750_CONTINUOUS_HIGH_RES_MODE  0x10
+
+// Start measurement at 0.5lx resolution. Measurement time is approx 120ms.
+#define BH1750_CONTINUOUS_HIGH_RES_MODE_2  0x11
+
+// Start measurement at 4lx resolution. Measurement time is approx 16ms.
+#define BH1750_CONTINUOUS_LOW_RES_MODE  0x13
+
+// Start measurement at 1lx resolution. Measurement time is approx 120ms.
+// Device is automatically set to Power Down after measurement.
+#define BH1750_ONE_TIME_HIGH_RES_MODE  0x20
+
+// Start measurement at 0.5lx resolution. Measurement time is approx 120ms.
+// Device is automatically set to Power Down after measurement.
+#define BH1750_ONE_TIME_HIGH_RES_MODE_2  0x21
+
+// Start measurement at 1lx resolution. Measurement time is approx 120ms.
+// Device is automatically set to Power Down after measurement.
+#define BH1750_ONE_TIME_LOW_RES_MODE  0x23
+
+// No hardware mode (sensor not initialized), fits into the 6-bit field of the packed state
+#define BH1750_NO_MODE 0x3F
+
+// Short pause after a mode command, otherwise the mode is not activated safely (ms)
+#define BH1750_SETTLE_TIME 5
+
+/** Virtual Modes */
+typedef enum
+{
+  RESOLUTION_LOW         = (1), /** 4lx resolution. Measurement time is approx 16ms. */  
+  RESOLUTION_NORMAL      = (2), /** 1lx resolution. Measurement time is approx 120ms. */
+  RESOLUTION_HIGH        = (3), /** 0,5lx resolution. Measurement time is approx 120ms. */
+  RESOLUTION_AUTO_HIGH   = (99) /** 0,11-1lx resolution. Measurement time is above 250ms. */
+  }  
+  sensors_resolution_t;
+
+typedef void (*DelayFuncPtr)(unsigned long);
+typedef unsigned long (*TimeFuncPtr)(void);
+typedef void (*EstimateFuncPtr)(float lux);
+
+// Version of the saved state (bh1750_state_t)
+#define BH1750_STATE_VERSION 1
+
+/** Learned state of the driver (saveState, begin) */
+typedef struct
+{
+  uint8_t version;          /** BH1750_STATE_VERSION */
+  uint8_t virtualMode;      /** sensors_resolution_t */
+  uint8_t hardwareMode;     /** last hardware mode (range) */
+  uint8_t MTreg;            /** last MTreg */
+  uint8_t autoPowerDown;
+  uint8_t flickerFrequency; /** 0, 100 or 120 Hz */
+  uint16_t lastRaw;         /** last raw value (light level) */
+  uint8_t crc;              /** CRC-8 over the preceding bytes */
+  }
+  bh1750_state_t;
+
+/** Result of a fast capture (capture) */
+typedef struct
+{
+  uint16_t samples;      /** number of samples read */
+  unsigned long duration; /** time from the first to the last sample (us) */
+  float sampleRate;      /** achieved sample rate (Hz) */
+  unsigned long jitter;  /** max. deviation of a sample from its schedule (us) */
+  float luxPerCount;     /** conversion factor of the raw values into lux */
+  }
+  bh1750_capture_t;
+
+// Stages of a measurement (bh1750_job_t)
+// not started
+#define BH1750_STAGE_IDLE 0
+// start: wake-up, warm start or probe
+#define BH1750_STAGE_START 1
+// measurement triggered by begin() or resume() is running (warm start)
+#define BH1750_STAGE_WARM 2
+// probe in LowResMode is started (automatic mode)
+#define BH1750_STAGE_PROBE 3
+// probe is running (automatic mode)
+#define BH1750_STAGE_RANGE 4
+// actual measurement is running
+#define BH1750_STAGE_MEASURE 5
+// finished, raw value available
+#define BH1750_STAGE_DONE 6
+// finished with error (not initialized or bus error)
+#define BH1750_STAGE_ERROR 7
+// finished with bus timeout
+#define BH1750_STAGE_TIMEOUT 8
+
+// Result of a measurement on bus timeout (-1: not initialized or other bus error)
+#define BH1750_TIMEOUT -2
+
+// Quantisation of the probe in raw counts (L-resolution: 4 lx steps)
+#define BH1750_PROBE_STEP 4
+
+// Default time budget of one bus transaction (us), see setBusTimeout
+#define BH1750_BUS_TIMEOUT 25000
+
+// Circuit breaker: consecutive failed measurements until the circuit opens (default)
+#define BH1750_BREAKER_THRESHOLD 3
+// Circuit breaker: max. threshold (7-bit counter in the packed state)
+#define BH1750_BREAKER_MAX_THRESHOLD 127
+// Circuit breaker: max. backoff level (an open circuit skips 2^(level-1) measurements)
+#define BH1750_BREAKER_MAX_BACKOFF 7
+
+/** Transition counters of the circuit breaker (all sensors) */
+typedef struct
+{
+  uint16_t opened;     /** closed -> open: too many consecutive failures */
+  uint16_t rejected;   /** measurements failed fast while open (no bus access) */
+  uint16_t halfOpened; /** open -> half-open: recovery attempt (bus clear, re-init) */
+  uint16_t reopened;   /** half-open -> open: recovery failed, longer backoff */
+  uint16_t closed;     /** half-open -> closed: sensor responds again */
+  uint16_t busClears;  /** bus clear sequences (9 SCL pulses) */
+  }
+  bh1750_breaker_stats_t;
+
+/** One measurement in progress (the stage machine of the core). */
+typedef struct
+{
+  uint16_t raw;      /** raw value (BH1750_STAGE_DONE) */
+  uint16_t wait;     /** time until the next step (ms) */
+  uint8_t stage:7;     /** BH1750_STAGE_... */
+  uint8_t triggered:1; /** the conversion of the result was started by this measurement */
+  uint16_t estimate; /** raw value of the probe (automatic mode, from BH1750_STAGE_MEASURE on) */
+  }
+  bh1750_job_t;
+
+// Status flags of a measurement (bh1750_measurement_t)
+// raw value and lux are valid
+#define BH1750_MEASUREMENT_VALID 0x01
+// raw value at the upper limit of the range (65535), the light may be brighter
+#define BH1750_MEASUREMENT_SATURATED 0x02
+// not initialized or bus error
+#define BH1750_MEASUREMENT_ERROR 0x04
+// bus timeout
+#define BH1750_MEASUREMENT_TIMEOUT 0x08
+// measurement still running (asynchronous driver)
+#define BH1750_MEASUREMENT_RUNNING 0x10
+// measurement still running, lux is the estimate of the probe (automatic mode, 4 lx resolution)
+#define BH1750_MEASUREMENT_ESTIMATE 0x20
+
+/** Result of a measurement with its context */
+typedef struct
+{
+  float lux;           /** light level, or -1 (error), BH1750_TIMEOUT, -100 (running) like readLightLevel, or the estimate (BH1750_MEASUREMENT_ESTIMATE) */
+  unsigned long start; /** start of the integration (time function, ms) */
+  unsigned long end;   /** end of the integration (start + typical measurement time) */
+  uint16_t raw;        /** raw value (counts) */
+  uint8_t MTreg;       /** MTreg of the measurement */
+  uint8_t mode;        /** hardware mode of the measurement (BH1750_..._MODE) */
+  uint8_t status;      /** BH1750_MEASUREMENT_... flags */
+  }
+  bh1750_measurement_t;
+
+/** Raw value with its scaling context (readRaw), converted later e.g. with convertBatch (AS_BH1750Batch.h) */
+typedef struct
+{
+  uint16_t raw;  /** raw value (counts) */
+  uint8_t MTreg; /** MTreg of the measurement */
+  uint8_t mode;  /** hardware mode of the measurement (BH1750_..._MODE) */
+  }
+  bh1750_record_t;
+
+// Noise model of the planner (plan): random noise of one sample (counts rms), it dithers the quantisation,
+// so averaging n samples reduces the standard error by sqrt(n).
+// The datasheet gives no noise figure: 1 count is an assumption (consecutive readings at constant light
+// differing by one count). With less noise, averaging reduces the quantisation error less than planned.
+// Can be defined before (build flag) with the standard deviation of readings at constant light (e.g. capture()).
+#ifndef BH1750_NOISE_COUNTS
+#define BH1750_NOISE_COUNTS 1.0f
+#endif
+// Planner: max. number of averaged samples
+#define BH1750_PLAN_MAX_SAMPLES 64
+// Planner: max. counts at the planned light level (headroom for changes until the measurement)
+#define BH1750_PLAN_MAX_COUNTS 50000
+
+/** Measurement plan for a target standard error (plan, readPlanned) */
+typedef struct
+{
+  float error;     /** expected standard error (lux) */
+  uint16_t time;   /** expected completion time (ms) */
+  uint8_t mode;    /** hardware mode (continuous) */
+  uint8_t MTreg;
+  uint8_t samples; /** number of averaged samples */
+  }
+  bh1750_plan_t;
+
+// Low-light accumulation (accumulate): integration period of H-resolution mode 2 at MTreg 254 (us, typical)
+#define BH1750_ACCUMULATE_PERIOD (120000UL * BH1750_MTREG_MAX / BH1750_MTREG_DEFAULT)
+// Low-light accumulation: polling interval of the data register (ms), locates the end of an integration
+#define BH1750_ACCUMULATE_POLL 4
+
+/** Result of a low-light accumulation (accumulate) */
+typedef struct
+{
+  uint32_t sum;           /** sum of the raw values (counts) */
+  uint16_t samples;       /** number of accumulated integrations */
+  uint16_t observed;      /** integrations whose end was seen on the data register */
+  uint16_t missed;        /** integrations that ended unseen between two readings (not accumulated) */
+  unsigned long period;   /** measured integration period (us), the typical one if no end was seen */
+  unsigned long duration; /** accumulated integration time (ms) */
+  float lux;              /** mean light level (lux) */
+  float resolution;       /** resolution of the mean (lux per count of the sum) */
+  float error;            /** estimated standard error of the mean (lux) */
+  }
+  bh1750_accumulation_t;
+
+/** Light level threshold with its raw value cached for one MTreg and mode (rawThreshold) */
+typedef struct
+{
+  float lux;     /** threshold (lux) */
+  uint16_t raw;  /** smallest raw value reaching the threshold with MTreg and mode */
+  uint8_t MTreg; /** MTreg of the cached raw value (0: not yet computed) */
+  uint8_t mode;  /** hardware mode of the cached raw value */
+  }
+  bh1750_threshold_t;
+
+// Initializer of a threshold, e.g.: bh1750_threshold_t alarm = BH1750_THRESHOLD(400);
+#define BH1750_THRESHOLD(lux) { (lux), 0, 0, 0 }
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Fixed_h
+#define AS_BH1750Fixed_h
+
+#include "AS_BH1750Defs.h"
+#include "AS_BH1750Tables.h"
+
+/*
+ Header-only configuration of the driver for one fixed hardware mode and MTreg.
+
+ Mode, MTreg and address are template parameters, bus, delay and clock are
+ policy classes with static inline functions. Measurement time and lux factor
+ are compile-time constants (see AS_BH1750Tables.h), so a measurement compiles
+ down to the bus calls and one delay, without function pointers:
+
+   AS_BH1750Fixed<BH1750_ONE_TIME_HIGH_RES_MODE> sensor;
+   sensor.begin();
+   float lux = sensor.readLightLevel();
+
+ Own policies (e.g. a second I2C bus or a sleeping delay) only need the
+ static functions of BH1750WireBus, BH1750ArduinoDelay or BH1750ArduinoClock.
+*/
+
+/** Bus policy: BH1750_WIRE (default: Wire). */
+struct BH1750WireBus {
+  static inline void begin(void) {
+    BH1750_WIRE.begin();
+  }
+
+  static inline bool write(uint8_t address, uint8_t data) {
+    BH1750_WIRE.beginTransmission(address);
+#if (ARDUINO >= 100)
+    BH1750_WIRE.write(data);
+#else
+    BH1750_WIRE.send(data);
+#endif
+    return (BH1750_WIRE.endTransmission()==0);
+  }
+
+  static inline bool read16(uint8_t address, uint16_t& value) {
+    if(BH1750_WIRE.requestFrom((int)address, 2)!=2) {
+      return false;
+    }
+#if (ARDUINO >= 100)
+    value = BH1750_WIRE.read();
+    value <<= 8;
+    value |= BH1750_WIRE.read();
+#else
+    value = BH1750_WIRE.receive();
+    value <<= 8;
+    value |= BH1750_WIRE.receive();
+#endif
+    return true;
+  }
+};
+
+/** Delay policy: delay(). */
+struct BH1750ArduinoDelay {
+  static inline void wait(unsigned long ms) {
+    delay(ms);
+  }
+};
+
+/** Clock policy: millis(). */
+struct BH1750ArduinoClock {
+  static inline unsigned long now(void) {
+    return millis();
+  }
+};
+
+/**
+ * BH1750 driver for a fixed hardware mode and MTreg (header-only, no virtual or automatic modes).
+ * - Mode: BH1750_CONTINUOUS_... or BH1750_ONE_TIME_... (one-time modes: the sensor powers down after each measurement)
+ * - MTreg: BH1750_MTREG_MIN..BH1750_MTREG_MAX
+ */
+template <uint8_t Mode, uint8_t MTreg = BH1750_MTREG_DEFAULT, uint8_t Address = BH1750_DEFAULT_I2CADDR,
+  class Bus = BH1750WireBus, class Delay = BH1750ArduinoDelay, class Clock = BH1750ArduinoClock>
+class AS_BH1750Fixed {
+public:
+  static_assert(Mode==BH1750_CONTINUOUS_HIGH_RES_MODE || Mode==BH1750_CONTINUOUS_HIGH_RES_MODE_2 ||
+    Mode==BH1750_CONTINUOUS_LOW_RES_MODE || Mode==BH1750_ONE_TIME_HIGH_RES_MODE ||
+    Mode==BH1750_ONE_TIME_HIGH_RES_MODE_2 || Mode==BH1750_ONE_TIME_LOW_RES_MODE, "AS_BH1750Fixed: invalid hardware mode");
+  static_assert(MTreg>=BH1750_MTREG_MIN && MTreg<=BH1750_MTREG_MAX, "AS_BH1750Fixed: MTreg out of range");
+
+  // one-time mode (trigger per measurement)
+  static constexpr bool oneTime = (Mode&0x20)!=0;
+  // L-resolution
+  static constexpr bool lowRes = (Mode&0x03)==0x03;
+  // typical measurement time (ms)
+  static constexpr uint16_t measurementTime = lowRes ? bh1750TimeLow(MTreg) : bh1750TimeHigh(MTreg);
+  // fixed point shift of the lux factor (H-resolution mode 2: half a count)
+  static constexpr uint8_t scaleShift = (Mode&0x03)==0x01 ? BH1750_SCALE_SHIFT+1 : BH1750_SCALE_SHIFT;
+
+  AS_BH1750Fixed() : _start(0), _first(false) {}
+
+  /**
+   * Initializes bus and sensor (MTreg, continuous modes: start of the measurement).
+   * Returns false if the sensor does not respond.
+   */
+  bool begin(void) {
+    Bus::begin();
+    // MTreg in two steps: 01000_MT[7,6,5] and 011_MT[4,3,2,1,0]
+    if(!Bus::write(Address, 0b01000000 | (MTreg>>5)) || !Bus::write(Address, 0b01100000 | (MTreg&0b00011111))) {
+      return false;
+    }
+    _start = Clock::now();
+    _first = !oneTime;
+    return Bus::write(Address, oneTime ? BH1750_POWER_DOWN : Mode);
+  }
+
+  /**
+   * Raw value of a complete measurement (one-time modes: trigger and wait, continuous modes: last value;
+   * the first read after begin() waits for the first conversion, as in the core).
+   */
+  bool readRaw(uint16_t& raw) {
+    if(oneTime) {
+      if(!Bus::write(Address, Mode)) {
+        return false;
+      }
+      Delay::wait(BH1750_SETTLE_TIME + measurementTime);
+    }
+    else if(_first) {
+      unsigned long elapsed = Clock::now() - _start;
+      if(elapsed<(unsigned long)(BH1750_SETTLE_TIME + measurementTime)) {
+        Delay::wait(BH1750_SETTLE_TIME + measurementTime - elapsed);
+      }
+      _first = false;
+    }
+    return Bus::read16(Address, raw);
+  }
+
+  /**
+   * Light level in lux of a complete measurement, -1 on bus error.
+   */
+  float readLightLevel(void) {
+    uint16_t raw;
+    if(!readRaw(raw)) {
+      return -1;
+    }
+    return convertRawValue(raw);
+  }
+
+  /**
+   * Asynchronous measurement: start (one-time modes: trigger), ready after the measurement time, read.
+   */
+  bool startMeasurementAsync(void) {
+    _start = Clock::now();
+    return !oneTime || Bus::write(Address, Mode);
+  }
+
+  bool isMeasurementReady(void) {
+    return (unsigned long)(Clock::now() - _start) >= (unsigned long)(BH1750_SETTLE_TIME + measurementTime);
+  }
+
+  float readLightLevelAsync(void) {
+    uint16_t raw;
+    if(!Bus::read16(Address, raw)) {
+      return -1;
+    }
+    return convertRawValue(raw);
+  }
+
+  /**
+   * Conversion into lux (same arithmetic as the core, the factor is a compile-time constant).
+   */
+  static inline float convertRawValue(uint16_t raw) {
+    return (uint32_t)raw * bh1750ScaleQ15(MTreg) * (1.0f / (1UL << scaleShift));
+  }
+
+private:
+  unsigned long _start;
+  bool _first; // continuous modes: the first conversion after begin() is not yet complete
+};
+
+#endif
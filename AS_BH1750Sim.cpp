@@ -0,0 +1,1370 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Sim.h"
+
+#ifdef BH1750_HOST
+
+#include <math.h>
+#include <time.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "AS_BH1750.h"
+#include "AS_BH1750A.h"
+#include "AS_BH1750Fixed.h"
+
+// Transfer time of one byte (incl. ACK) at 100 kHz
+#define SIM_BYTE_TIME 90
+// Step width for the numerical integration of the scene
+#define SIM_INTEGRATION_STEP 50
+// Blocking time of a call on the stuck bus without timeout (stands for a hang)
+#define SIM_HANG_TIME 10000000UL
+
+const bh1750_scene_t BH1750_SCENES[] = {
+  // name           shape           level   level2   time      freq  depth
+  { "step",         SCENE_STEP,     100,    1000,    500000,   0,    0   },
+  { "sunrise",      SCENE_RAMP,     0.1,    20000,   10000000, 0,    0   },
+  { "flicker_50hz", SCENE_FLICKER,  300,    0,       0,        50,   0.5 },
+  { "flicker_100hz",SCENE_FLICKER,  300,    0,       0,        100,  0.5 },
+  { "clouds",       SCENE_CLOUDS,   20000,  0,       2000000,  0,    0.4 },
+  { "darkness",     SCENE_CONSTANT, 0.1,    0,       0,        0,    0   },
+  { "direct_sun",   SCENE_CONSTANT, 80000,  0,       0,        0,    0   }
+};
+const uint8_t BH1750_SCENE_COUNT = sizeof(BH1750_SCENES)/sizeof(BH1750_SCENES[0]);
+
+/**
+ * Deterministic noise in the range -1..1 for the given index.
+ */
+static float sceneNoise(uint32_t i) {
+  i = (i ^ 61) ^ (i >> 16);
+  i *= 9;
+  i ^= i >> 4;
+  i *= 0x27d4eb2d;
+  i ^= i >> 15;
+  return (i & 0xFFFF) / 32767.5f - 1;
+}
+
+float sceneLux(const bh1750_scene_t* scene, unsigned long us) {
+  switch (scene->shape) {
+  case SCENE_STEP:
+    return us<scene->time ? scene->level : scene->level2;
+  case SCENE_RAMP:
+    if(us>=scene->time) {
+      return scene->level2;
+    }
+    return scene->level + (scene->level2-scene->level) * ((float)us/scene->time);
+  case SCENE_FLICKER:
+    return scene->level * (1 + scene->depth * sin(2*M_PI*scene->frequency*us/1000000.0));
+  case SCENE_CLOUDS: {
+    // smooth interpolation between random support points
+    unsigned long k = us / scene->time;
+    float f = (float)(us % scene->time) / scene->time;
+    f = f*f*(3-2*f);
+    float n = sceneNoise(k)*(1-f) + sceneNoise(k+1)*f;
+    return scene->level * (1 + scene->depth * n);
+  }
+  default:
+    return scene->level;
+  }
+}
+
+float sceneMeanLux(const bh1750_scene_t* scene, unsigned long from, unsigned long to) {
+  if(to<=from) {
+    return sceneLux(scene, from);
+  }
+  double sum = 0;
+  unsigned long n = 0;
+  for(unsigned long t = from+SIM_INTEGRATION_STEP/2; t<to; t+=SIM_INTEGRATION_STEP) {
+    sum += sceneLux(scene, t);
+    n++;
+  }
+  return n>0 ? sum/n : sceneLux(scene, from);
+}
+
+/**
+ * Host CPU time (ns) and, on x86, the time stamp counter.
+ */
+static void simCpuNow(double* ns, unsigned long long* cycles) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  *ns = ts.tv_sec * 1e9 + ts.tv_nsec;
+#if defined(__x86_64__) || defined(__i386__)
+  *cycles = __rdtsc();
+#else
+  *cycles = 0;
+#endif
+}
+
+// Host CPU time spent in the simulated sensor (bus and clock calls) while simCpuActive,
+// subtracted by the API benchmark so that it reports the driver code only
+static bool simCpuActive = false;
+static uint8_t simCpuDepth = 0;
+static double simCpuNs = 0;
+static unsigned long long simCpuCycles = 0;
+
+/**
+ * Adds the CPU time of a call into the simulated sensor (outermost call only).
+ */
+class SimCpuScope {
+public:
+  SimCpuScope() : _active(simCpuActive && simCpuDepth++==0) {
+    if(_active) {
+      simCpuNow(&_ns, &_cycles);
+    }
+  }
+  ~SimCpuScope() {
+    if(simCpuActive && simCpuDepth>0) {
+      simCpuDepth--;
+    }
+    if(_active) {
+      double ns;
+      unsigned long long cycles;
+      simCpuNow(&ns, &cycles);
+      simCpuNs += ns-_ns;
+      simCpuCycles += cycles-_cycles;
+    }
+  }
+private:
+  bool _active;
+  double _ns;
+  unsigned long long _cycles;
+};
+
+BH1750SimDevice BH1750Sim;
+
+void simDelay(unsigned long ms) {
+  BH1750Sim.delay(ms);
+}
+
+unsigned long simMillis(void) {
+  BH1750Sim.advance(1);
+  return BH1750Sim.millis();
+}
+
+unsigned long simMicros(void) {
+  BH1750Sim.advance(1);
+  return BH1750Sim.micros();
+}
+
+BH1750SimDevice::BH1750SimDevice(uint8_t address) {
+  _address = address;
+  reset(&BH1750_SCENES[0]);
+}
+
+void BH1750SimDevice::reset(const bh1750_scene_t* scene) {
+  _scene = scene;
+  _now = 0;
+  _transactions = 0;
+  _bytes = 0;
+  _delayed = 0;
+  _powered = false;
+  _mode = 0;
+  _MTreg = 69;
+  _activeMTreg = 69;
+  _start = 0;
+  _deviation = 0;
+  _data = 0;
+  _truth = 0;
+  _txAddress = -1;
+  _txCount = 0;
+  _rxCount = 0;
+  _rxPos = 0;
+  _stuck = false;
+  _timeout = 0;
+  _timeoutFlag = false;
+  _faults = NULL;
+  _faultCount = 0;
+  _injected = 0;
+}
+
+const bh1750_scene_t* BH1750SimDevice::scene(void) {
+  return _scene;
+}
+
+void BH1750SimDevice::begin(void) {
+  SimCpuScope scope;
+}
+
+void BH1750SimDevice::beginTransmission(int address) {
+  SimCpuScope scope;
+  _txAddress = address;
+  _txCount = 0;
+}
+
+size_t BH1750SimDevice::write(uint8_t data) {
+  SimCpuScope scope;
+  if(_txCount>=sizeof(_txData)) {
+    return 0;
+  }
+  _txData[_txCount++] = data;
+  return 1;
+}
+
+uint8_t BH1750SimDevice::endTransmission(void) {
+  SimCpuScope scope;
+  uint32_t param;
+  uint8_t fault = activeFault(param);
+  _transactions++;
+  if(stuck()) {
+    _txCount = 0;
+    return _timeout>0 ? 5 : 4; // timeout, or other error after the 'hang'
+  }
+  if(fault==SIM_FAULT_CLOCK_STRETCH && stretch(param)) {
+    _txCount = 0;
+    return 5;
+  }
+  advance((1+_txCount)*SIM_BYTE_TIME);
+  _bytes += 1+_txCount;
+  if(_txAddress!=_address || fault==SIM_FAULT_NACK_ADDRESS) {
+    return 2; // NACK on address
+  }
+  update();
+  if(fault==SIM_FAULT_POWER_DOWN) {
+    _powered = false;
+    _mode = 0;
+  }
+  if(fault==SIM_FAULT_NACK_DATA && _txCount>0) {
+    _txCount = 0;
+    return 3; // NACK on data
+  }
+  if(fault==SIM_FAULT_BIT_FLIP && _txCount>0) {
+    _txData[0] ^= 1<<(param&7);
+  }
+  for(uint8_t i=0; i<_txCount; i++) {
+    command(_txData[i]);
+  }
+  _txCount = 0;
+  return 0;
+}
+
+uint8_t BH1750SimDevice::requestFrom(int address, int quantity) {
+  SimCpuScope scope;
+  if(quantity>2) {
+    quantity = 2;
+  }
+  uint32_t param;
+  uint8_t fault = activeFault(param);
+  _transactions++;
+  _rxCount = 0;
+  _rxPos = 0;
+  if(stuck()) {
+    return 0;
+  }
+  if(fault==SIM_FAULT_CLOCK_STRETCH && stretch(param)) {
+    return 0;
+  }
+  advance((1+quantity)*SIM_BYTE_TIME);
+  _bytes += 1+quantity;
+  if(address!=_address || fault==SIM_FAULT_NACK_ADDRESS) {
+    return 0;
+  }
+  update();
+  if(fault==SIM_FAULT_POWER_DOWN) {
+    _powered = false;
+    _mode = 0;
+  }
+  uint16_t data = _data;
+  if(fault==SIM_FAULT_BIT_FLIP) {
+    data ^= 1<<(param&15);
+  }
+  if(fault==SIM_FAULT_SHORT_READ && quantity>1) {
+    quantity = 1;
+  }
+  _rxData[0] = data>>8;
+  _rxData[1] = data&0xFF;
+  _rxCount = quantity;
+  return quantity;
+}
+
+int BH1750SimDevice::available(void) {
+  SimCpuScope scope;
+  return _rxCount-_rxPos;
+}
+
+int BH1750SimDevice::read(void) {
+  SimCpuScope scope;
+  if(_rxPos>=_rxCount) {
+    return -1;
+  }
+  return _rxData[_rxPos++];
+}
+
+void BH1750SimDevice::setWireTimeout(uint32_t timeout, bool /*reset*/) {
+  SimCpuScope scope;
+  _timeout = timeout;
+}
+
+bool BH1750SimDevice::getWireTimeoutFlag(void) {
+  SimCpuScope scope;
+  return _timeoutFlag;
+}
+
+void BH1750SimDevice::clearWireTimeoutFlag(void) {
+  SimCpuScope scope;
+  _timeoutFlag = false;
+}
+
+void BH1750SimDevice::setStuckBus(bool stuck) {
+  _stuck = stuck;
+}
+
+/**
+ * Transaction on the stuck bus (SDA held low): blocks until the timeout expires
+ * (or SIM_HANG_TIME without timeout). Returns true if the bus is stuck.
+ */
+bool BH1750SimDevice::stuck(void) {
+  if(!_stuck) {
+    return false;
+  }
+  if(_timeout>0) {
+    advance(_timeout);
+    _timeoutFlag = true;
+  } else {
+    advance(SIM_HANG_TIME);
+  }
+  return true;
+}
+
+void BH1750SimDevice::setFaults(const bh1750_sim_fault_step_t* script, uint8_t count) {
+  _faults = script;
+  _faultCount = script!=NULL ? count : 0;
+}
+
+unsigned long BH1750SimDevice::injectedFaults(void) {
+  return _injected;
+}
+
+/**
+ * Fault of the script for the current transaction (SIM_FAULT_NONE if none).
+ */
+uint8_t BH1750SimDevice::activeFault(uint32_t& param) {
+  param = 0;
+  for(uint8_t i=0; i<_faultCount; i++) {
+    const bh1750_sim_fault_step_t& f = _faults[i];
+    if(_transactions>=f.transaction && _transactions<f.transaction+f.count) {
+      _injected++;
+      param = f.param;
+      return f.fault;
+    }
+  }
+  return SIM_FAULT_NONE;
+}
+
+/**
+ * Clock stretching by the sensor. Returns true if the bus timeout expires first.
+ */
+bool BH1750SimDevice::stretch(uint32_t us) {
+  if(_timeout>0 && us>=_timeout) {
+    advance(_timeout);
+    _timeoutFlag = true;
+    return true;
+  }
+  advance(us);
+  return false;
+}
+
+void BH1750SimDevice::delay(unsigned long ms) {
+  SimCpuScope scope;
+  advance(ms*1000);
+  _delayed += ms*1000;
+}
+
+void BH1750SimDevice::advance(unsigned long us) {
+  SimCpuScope scope;
+  _now += us;
+}
+
+unsigned long BH1750SimDevice::millis(void) {
+  SimCpuScope scope;
+  return _now/1000;
+}
+
+unsigned long BH1750SimDevice::micros(void) {
+  SimCpuScope scope;
+  return _now;
+}
+
+void BH1750SimDevice::setClockDeviation(float deviation) {
+  _deviation = deviation;
+}
+
+/**
+ * Typical measurement time: 120 ms (H-resolution) or 16 ms (L-resolution) at MTreg 69,
+ * proportional to MTreg, scaled by the clock deviation.
+ */
+unsigned long BH1750SimDevice::integrationTime(uint8_t mode) {
+  unsigned long t = (mode&0x0F)==0x03 ? 16000UL : 120000UL;
+  t = t * _activeMTreg / 69;
+  return _deviation==0 ? t : (unsigned long)(t * (1.0 + _deviation));
+}
+
+float BH1750SimDevice::dataTruth(void) {
+  return _truth;
+}
+
+bool BH1750SimDevice::measuring(void) {
+  update();
+  return _powered && _mode!=0;
+}
+
+unsigned long BH1750SimDevice::transactions(void) {
+  return _transactions;
+}
+
+unsigned long BH1750SimDevice::bytes(void) {
+  return _bytes;
+}
+
+unsigned long BH1750SimDevice::delayed(void) {
+  return _delayed;
+}
+
+/**
+ * Completes all integrations that have ended up to the current time.
+ */
+void BH1750SimDevice::update(void) {
+  if(!_powered || _mode==0) {
+    return;
+  }
+  unsigned long tInt = integrationTime(_mode);
+  if(_now<_start+tInt) {
+    return;
+  }
+  if((_mode&0x20)==0) {
+    // continuous: only the last completed window is relevant
+    unsigned long n = (_now-_start)/tInt;
+    _start += (n-1)*tInt;
+  }
+
+  float lux = sceneMeanLux(_scene, _start, _start+tInt);
+  float counts = lux * 1.2f * _activeMTreg / 69;
+  switch (_mode&0x0F) {
+  case 0x01: // H-resolution mode 2
+    counts *= 2;
+    break;
+  case 0x03: // L-resolution: 4 lx steps
+    counts = floor(counts/4)*4;
+    break;
+  default:
+    break;
+  }
+  _data = counts>=65535 ? 65535 : (uint16_t)counts;
+  _truth = lux;
+
+  if(_mode&0x20) {
+    // one time: power down after the measurement
+    _mode = 0;
+    _powered = false;
+  } else {
+    _start += tInt;
+  }
+}
+
+void BH1750SimDevice::command(uint8_t cmd) {
+  if((cmd&0xF8)==0x40) {
+    _MTreg = (_MTreg&0x1F) | ((cmd&0x07)<<5);
+    return;
+  }
+  if((cmd&0xE0)==0x60) {
+    _MTreg = (_MTreg&0xE0) | (cmd&0x1F);
+    return;
+  }
+  switch (cmd) {
+  case 0x00: // power down
+    _powered = false;
+    _mode = 0;
+    break;
+  case 0x01: // power on
+    _powered = true;
+    break;
+  case 0x07: // reset
+    if(_powered) {
+      _data = 0;
+    }
+    break;
+  case 0x10:
+  case 0x11:
+  case 0x13:
+  case 0x20:
+  case 0x21:
+  case 0x23:
+    _powered = true;
+    _mode = cmd;
+    _activeMTreg = _MTreg;
+    _start = _now;
+    break;
+  default:
+    break;
+  }
+}
+
+bh1750_sim_result_t simRunScene(SimReadFuncPtr fReadPtr, uint16_t readings, unsigned long interval) {
+  bh1750_sim_result_t r;
+  r.scene = BH1750Sim.scene()->name;
+  r.readings = 0;
+  r.meanAbsError = 0;
+  r.maxRelError = 0;
+  r.meanLatency = 0;
+  r.maxLatency = 0;
+
+  double sumError = 0;
+  unsigned long sumLatency = 0;
+  for(uint16_t i=0; i<readings; i++) {
+    unsigned long t0 = BH1750Sim.micros();
+    float lux = fReadPtr();
+    unsigned long latency = BH1750Sim.micros()-t0;
+    float truth = BH1750Sim.dataTruth();
+    float error = fabs(lux-truth);
+    sumError += error;
+    if(truth>0 && error/truth>r.maxRelError) {
+      r.maxRelError = error/truth;
+    }
+    sumLatency += latency;
+    if(latency>r.maxLatency) {
+      r.maxLatency = latency;
+    }
+    r.readings++;
+    BH1750Sim.delay(interval);
+  }
+  if(r.readings>0) {
+    r.meanAbsError = sumError/r.readings;
+    r.meanLatency = sumLatency/r.readings;
+  }
+  return r;
+}
+
+bh1750_spectrum_t captureSpectrum(const uint16_t* raw, uint16_t count, float sampleRate) {
+  bh1750_spectrum_t r;
+  r.mean = 0;
+  r.peakFrequency = 0;
+  r.peakAmplitude = 0;
+  r.modulation = 0;
+  if(count<4) {
+    return r;
+  }
+
+  double sum = 0;
+  for(uint16_t i=0; i<count; i++) {
+    sum += raw[i];
+  }
+  r.mean = sum/count;
+
+  // DFT of the windowed signal without DC, amplitude corrected for the Hann window (gain 0.5)
+  for(uint16_t k=1; k<=count/2; k++) {
+    double re = 0;
+    double im = 0;
+    for(uint16_t i=0; i<count; i++) {
+      double w = 0.5 - 0.5*cos(2*M_PI*i/(count-1));
+      double x = (raw[i]-r.mean)*w;
+      re += x*cos(2*M_PI*k*i/count);
+      im -= x*sin(2*M_PI*k*i/count);
+    }
+    float amplitude = 2*sqrt(re*re+im*im)/(0.5*count);
+    if(amplitude>r.peakAmplitude) {
+      r.peakAmplitude = amplitude;
+      r.peakFrequency = k*sampleRate/count;
+    }
+  }
+  r.modulation = r.mean>0 ? r.peakAmplitude/r.mean : 0;
+  return r;
+}
+
+static AS_BH1750* benchSensor;
+// readings of the scene benchmark outside their error and latency bound
+static uint16_t benchErrors;
+static uint16_t benchSlow;
+
+/**
+ * Reads and checks against the bounds of the range in use.
+ * Error: one quantisation step (4 counts in L-resolution); in the fixed modes plus the part
+ * of the true level above full scale (saturation), the automatic mode has to change the range.
+ * Latency: settling pause, measurement time and 1 ms for the bus; in the automatic mode
+ * plus the probe in L-resolution (settling pause, 16 ms) and 2 ms for its bus phases.
+ */
+static float benchRead(void) {
+  unsigned long t0 = BH1750Sim.micros();
+  float lux = benchSensor->readLightLevel(&simDelay);
+  unsigned long latency = BH1750Sim.micros()-t0;
+  bh1750_state_t state;
+  benchSensor->saveState(&state);
+  bool autoRange = state.virtualMode==RESOLUTION_AUTO_HIGH;
+  bool lowRes = (state.hardwareMode&0x0F)==0x03;
+
+  float truth = BH1750Sim.dataTruth();
+  float full = bh1750Lux(65535, state.MTreg, state.hardwareMode);
+  float bound = bh1750Lux(lowRes ? 4 : 1, state.MTreg, state.hardwareMode)
+    + (!autoRange && truth>full ? truth-full : 0);
+  if(!(fabs(lux-truth)<=bound)) {
+    benchErrors++;
+  }
+  unsigned long maxLatency = BH1750_SETTLE_TIME*1000UL + (lowRes ? 16000UL : 120000UL) * state.MTreg / BH1750_MTREG_DEFAULT + 1000
+    + (autoRange ? (BH1750_SETTLE_TIME+16)*1000UL + 2000 : 0);
+  if(latency>maxLatency) {
+    benchSlow++;
+  }
+  return lux;
+}
+
+unsigned long simSceneBenchmark(FILE* out) {
+  const sensors_resolution_t modes[] = { RESOLUTION_LOW, RESOLUTION_NORMAL, RESOLUTION_HIGH, RESOLUTION_AUTO_HIGH };
+  const char* modeNames[] = { "LOW", "NORMAL", "HIGH", "AUTO_HIGH" };
+  unsigned long violations = 0;
+  for(uint8_t m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+    for(uint8_t s=0; s<BH1750_SCENE_COUNT; s++) {
+      AS_BH1750 sensor;
+      benchSensor = &sensor;
+      benchErrors = 0;
+      benchSlow = 0;
+      BH1750Sim.reset(&BH1750_SCENES[s]);
+      sensor.begin(modes[m], true);
+      bh1750_sim_result_t r = simRunScene(&benchRead, 20, 1000);
+      bool valid = benchErrors==0 && benchSlow==0;
+      violations += valid ? 0 : 1;
+      fprintf(out, "%-14s %-10s n=%u error=%.3f lx max=%.2f%% latency=%lu/%lu us out of bound: error=%u latency=%u %s\n",
+        r.scene, modeNames[m], r.readings, r.meanAbsError, r.maxRelError*100, r.meanLatency, r.maxLatency,
+        benchErrors, benchSlow, valid ? "ok" : "VIOLATION");
+    }
+  }
+  fprintf(out, "scene benchmark: violations=%lu\n", violations);
+  return violations;
+}
+
+// Delay and clock policies of AS_BH1750Fixed on the virtual clock
+struct BH1750SimDelay {
+  static inline void wait(unsigned long ms) {
+    simDelay(ms);
+  }
+};
+
+struct BH1750SimClock {
+  static inline unsigned long now(void) {
+    return simMillis();
+  }
+};
+
+/**
+ * Runs 'readings' measurements with a read function and prints host CPU time,
+ * bus transactions and virtual latency per measurement.
+ */
+static void inlineBenchLine(FILE* out, const char* name, const char* driver, size_t size, SimReadFuncPtr fReadPtr, uint16_t readings) {
+  unsigned long transactions = BH1750Sim.transactions();
+  unsigned long t0 = BH1750Sim.micros();
+  float sum = 0;
+  clock_t c0 = clock();
+  for(uint16_t i=0; i<readings; i++) {
+    sum += fReadPtr();
+  }
+  double cpu = (double)(clock()-c0)/CLOCKS_PER_SEC;
+  fprintf(out, "%-16s %-8s size=%2u B cpu=%7.0f ns bus=%.1f latency=%lu us mean=%.2f lx\n",
+    name, driver, (unsigned)size, cpu*1e9/readings, (double)(BH1750Sim.transactions()-transactions)/readings,
+    (BH1750Sim.micros()-t0)/readings, sum/readings);
+}
+
+static AS_BH1750* inlineSensor;
+static AS_BH1750Fixed<BH1750_ONE_TIME_LOW_RES_MODE, BH1750_MTREG_DEFAULT, BH1750_DEFAULT_I2CADDR, BH1750WireBus, BH1750SimDelay, BH1750SimClock> fixedLow;
+static AS_BH1750Fixed<BH1750_ONE_TIME_HIGH_RES_MODE, BH1750_MTREG_DEFAULT, BH1750_DEFAULT_I2CADDR, BH1750WireBus, BH1750SimDelay, BH1750SimClock> fixedHigh;
+static AS_BH1750Fixed<BH1750_CONTINUOUS_HIGH_RES_MODE, BH1750_MTREG_DEFAULT, BH1750_DEFAULT_I2CADDR, BH1750WireBus, BH1750SimDelay, BH1750SimClock> fixedContinuous;
+
+static float inlineRead(void) {
+  return inlineSensor->readLightLevel(&simDelay);
+}
+
+static float fixedLowRead(void) {
+  return fixedLow.readLightLevel();
+}
+
+static float fixedHighRead(void) {
+  return fixedHigh.readLightLevel();
+}
+
+static float fixedContinuousRead(void) {
+  return fixedContinuous.readLightLevel();
+}
+
+void simInlineBenchmark(FILE* out, uint16_t readings) {
+  AS_BH1750 sensor;
+  inlineSensor = &sensor;
+
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  sensor.begin(RESOLUTION_LOW, true);
+  inlineBenchLine(out, "ONE_TIME_LOW", "core", sizeof(sensor), &inlineRead, readings);
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  fixedLow.begin();
+  inlineBenchLine(out, "ONE_TIME_LOW", "fixed", sizeof(fixedLow), &fixedLowRead, readings);
+
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  sensor.begin(RESOLUTION_NORMAL, true);
+  inlineBenchLine(out, "ONE_TIME_HIGH", "core", sizeof(sensor), &inlineRead, readings);
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  fixedHigh.begin();
+  inlineBenchLine(out, "ONE_TIME_HIGH", "fixed", sizeof(fixedHigh), &fixedHighRead, readings);
+
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  sensor.begin(RESOLUTION_NORMAL, false);
+  simDelay(200); // first continuous measurement
+  inlineBenchLine(out, "CONTINUOUS_HIGH", "core", sizeof(sensor), &inlineRead, readings);
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  fixedContinuous.begin();
+  simDelay(200);
+  inlineBenchLine(out, "CONTINUOUS_HIGH", "fixed", sizeof(fixedContinuous), &fixedContinuousRead, readings);
+}
+
+unsigned long simStuckBusBenchmark(FILE* out, unsigned long timeout) {
+  const sensors_resolution_t modes[] = { RESOLUTION_LOW, RESOLUTION_NORMAL, RESOLUTION_HIGH, RESOLUTION_AUTO_HIGH };
+  const char* modeNames[] = { "LOW", "NORMAL", "HIGH", "AUTO_HIGH" };
+  unsigned long violations = 0;
+  AS_BH1750::setBusTimeout(timeout);
+  for(uint8_t m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+    AS_BH1750 sensor;
+    BH1750Sim.reset(&BH1750_SCENES[0]);
+    sensor.begin(modes[m], true);
+    sensor.readLightLevel(&simDelay);
+    BH1750Sim.setStuckBus(true);
+    unsigned long maxLatency = 0;
+    uint8_t timeouts = 0;
+    uint8_t rejected = 0;
+    // expected sequence of the circuit breaker: T (BH1750_TIMEOUT) until the threshold,
+    // then per backoff level 2^(level-1) rejected calls (-1) and one recovery attempt (T)
+    char sequence[11];
+    char expected[11];
+    uint8_t failures = 0;
+    uint8_t level = 0;
+    uint8_t skip = 0;
+    for(uint8_t i=0; i<10; i++) {
+      if(level>0 && skip>0) {
+        skip--;
+        expected[i] = '-';
+      } else {
+        expected[i] = 'T';
+        if(level>0) {
+          level += level<BH1750_BREAKER_MAX_BACKOFF ? 1 : 0;
+          skip = 1<<(level-1);
+        } else if(++failures>=BH1750_BREAKER_THRESHOLD) {
+          level = 1;
+          skip = 1;
+        }
+      }
+
+      unsigned long t0 = BH1750Sim.micros();
+      float lux = sensor.readLightLevel(&simDelay);
+      if(lux==BH1750_TIMEOUT) {
+        timeouts++;
+        sequence[i] = 'T';
+      }
+      else if(lux==-1) {
+        rejected++;
+        sequence[i] = '-';
+      }
+      else {
+        sequence[i] = '?';
+      }
+      unsigned long latency = BH1750Sim.micros()-t0;
+      if(latency>maxLatency) {
+        maxLatency = latency;
+      }
+    }
+    sequence[10] = 0;
+    expected[10] = 0;
+    // at most one timeout per call, the breaker sequence as expected
+    bool valid = maxLatency<=timeout && strcmp(sequence, expected)==0;
+    violations += valid ? 0 : 1;
+    fprintf(out, "stuck_bus      %-10s timeout=%lu us timeouts=%u/10 failed=%u/10 max latency=%lu us sequence=%s (expected %s)%s\n",
+      modeNames[m], timeout, timeouts, rejected, maxLatency, sequence, expected, valid ? "" : " VIOLATION");
+    BH1750Sim.setStuckBus(false);
+  }
+  AS_BH1750::setBusTimeout(BH1750_BUS_TIMEOUT);
+  return violations;
+}
+
+// Constant light for the fault campaign
+static const bh1750_scene_t faultScene = { "constant", SCENE_CONSTANT, 300, 0, 0, 0, 0 };
+
+/**
+ * One measurement of the fault campaign with the blocking or the asynchronous driver.
+ * Returns false if the measurement did not reach DONE, ERROR or TIMEOUT (asynchronous: within 3 s).
+ */
+static bool faultRead(AS_BH1750* sensor, AS_BH1750A* sensorA, bh1750_measurement_t* m) {
+  if(sensor!=NULL) {
+    sensor->readMeasurement(m, &simDelay, &simMillis);
+    return (m->status&BH1750_MEASUREMENT_RUNNING)==0;
+  }
+  sensorA->startMeasurementAsync(&simMillis);
+  for(uint16_t i=0; i<3000; i++) {
+    if(sensorA->isMeasurementReady()) {
+      break;
+    }
+    simDelay(1);
+  }
+  return sensorA->readMeasurementAsync(m);
+}
+
+static bool faultCorrect(const bh1750_measurement_t* m) {
+  float truth = BH1750Sim.dataTruth();
+  return (m->status&BH1750_MEASUREMENT_VALID)!=0 && fabs(m->lux-truth)<=truth*0.02f+1;
+}
+
+/**
+ * Fault campaign of one bus verification setting. Returns the number of violations.
+ */
+static unsigned long faultCampaign(FILE* out, bool verify) {
+  const uint8_t faults[] = { SIM_FAULT_NACK_ADDRESS, SIM_FAULT_NACK_DATA, SIM_FAULT_SHORT_READ,
+    SIM_FAULT_CLOCK_STRETCH, SIM_FAULT_BIT_FLIP, SIM_FAULT_POWER_DOWN };
+  const char* faultNames[] = { "nack_address", "nack_data", "short_read", "clock_stretch", "bit_flip", "power_down" };
+  const uint32_t params[] = { 0, 0, 0, 50000, 14, 0 };
+  const sensors_resolution_t modes[] = { RESOLUTION_NORMAL, RESOLUTION_AUTO_HIGH };
+  const char* modeNames[] = { "NORMAL", "AUTO_HIGH" };
+  // fault at each of the first transactions of a measurement
+  const uint8_t offsets = 16;
+  unsigned long violations = 0;
+
+  AS_BH1750::setBusVerification(verify);
+  for(uint8_t f=0; f<sizeof(faults); f++) {
+    // without verification, a flipped bit is not detectable (no checksum)
+    bool detectable = verify || faults[f]!=SIM_FAULT_BIT_FLIP;
+    for(uint8_t d=0; d<2; d++) {
+      for(uint8_t m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+        uint8_t ok = 0;
+        uint8_t failed = 0;
+        uint8_t wrong = 0;
+        uint8_t stuck = 0;
+        uint8_t unflagged = 0;
+        uint8_t recovered = 0;
+        unsigned long bound = 0;
+        unsigned long maxLatency = 0;
+        for(uint8_t k=0; k<offsets; k++) {
+          AS_BH1750 sensor;
+          AS_BH1750A sensorA;
+          AS_BH1750* b = d==0 ? &sensor : NULL;
+          AS_BH1750A* a = d==1 ? &sensorA : NULL;
+          BH1750Sim.reset(&faultScene);
+          if(b!=NULL) {
+            b->begin(modes[m], true);
+          } else {
+            a->begin(modes[m], true);
+          }
+          // first measurement without fault (latency bound: fault-free latency plus one bus timeout)
+          bh1750_measurement_t r;
+          unsigned long t0 = BH1750Sim.micros();
+          faultRead(b, a, &r);
+          if(BH1750Sim.micros()-t0+BH1750_BUS_TIMEOUT>bound) {
+            bound = BH1750Sim.micros()-t0+BH1750_BUS_TIMEOUT;
+          }
+
+          bh1750_sim_fault_step_t step = { BH1750Sim.transactions()+k, 1, faults[f], params[f] };
+          BH1750Sim.setFaults(&step, 1);
+          t0 = BH1750Sim.micros();
+          if(!faultRead(b, a, &r)) {
+            stuck++;
+          }
+          unsigned long latency = BH1750Sim.micros()-t0;
+          if(latency>maxLatency) {
+            maxLatency = latency;
+          }
+          if(faultCorrect(&r)) {
+            ok++;
+          } else if((r.status&BH1750_MEASUREMENT_VALID)!=0) {
+            wrong++;
+          } else {
+            failed++;
+            // error status without lux, timeout only for a stretched clock
+            uint8_t expected = faults[f]==SIM_FAULT_CLOCK_STRETCH ? BH1750_MEASUREMENT_TIMEOUT : BH1750_MEASUREMENT_ERROR;
+            if(r.lux>=0 || (r.status&(BH1750_MEASUREMENT_ERROR|BH1750_MEASUREMENT_TIMEOUT))!=expected) {
+              unflagged++;
+            }
+          }
+
+          // the following measurement must be correct again
+          BH1750Sim.setFaults(NULL, 0);
+          t0 = BH1750Sim.micros();
+          if(faultRead(b, a, &r) && faultCorrect(&r)) {
+            recovered++;
+          }
+          if(BH1750Sim.micros()-t0+BH1750_BUS_TIMEOUT>bound) {
+            bound = BH1750Sim.micros()-t0+BH1750_BUS_TIMEOUT;
+          }
+        }
+        unsigned long v = stuck + unflagged + (maxLatency>bound ? 1 : 0);
+        if(detectable) {
+          v += wrong + (offsets-recovered);
+        }
+        violations += v;
+        fprintf(out, "%-14s %-10s %-10s %-8s ok=%u failed=%u wrong=%u unflagged=%u stuck=%u recovered=%u/%u max latency=%lu us (bound %lu)%s\n",
+          faultNames[f], d==0 ? "AS_BH1750" : "AS_BH1750A", modeNames[m], verify ? "verified" : "plain",
+          ok, failed, wrong, unflagged, stuck, recovered, offsets, maxLatency, bound, v>0 ? " VIOLATION" : "");
+      }
+    }
+  }
+  AS_BH1750::setBusVerification(false);
+  return violations;
+}
+
+unsigned long simFaultBenchmark(FILE* out) {
+  unsigned long violations = faultCampaign(out, false) + faultCampaign(out, true);
+  fprintf(out, "fault campaign: violations=%lu\n", violations);
+  return violations;
+}
+
+// Property check: max. bus transactions of a complete measurement (a read counts twice:
+// requestFrom and endTransmission): MTreg 2 + wake-up 1, probe MTreg 2 + mode 1, read 2, MTreg 2 + mode 1, read 2
+#define SIM_PROPERTY_MAX_TRANSACTIONS 13
+// Property check: max. steps of a measurement polled at the due times
+#define SIM_PROPERTY_MAX_POLLS 8
+// Property check: light changes within this time (us) before the start may still be read in continuous modes
+#define SIM_PROPERTY_SETTLE 300000UL
+
+/** Operations of the property check (one input byte, partly followed by an argument byte) */
+enum {
+  PROPERTY_START,
+  PROPERTY_POLL,
+  PROPERTY_READ,
+  PROPERTY_POWER_DOWN,
+  PROPERTY_CLOCK,
+  PROPERTY_FAULT,
+  PROPERTY_LEVEL,
+  PROPERTY_BLOCKING,
+  PROPERTY_DRAIN,
+  PROPERTY_COUNT
+};
+
+/** State of one property run */
+typedef struct
+{
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+  bh1750_sim_property_t* result;
+  FILE* log;
+  AS_BH1750A* sensor;
+  bh1750_scene_t scene;
+  sensors_resolution_t mode;
+  bool autoPowerDown;
+  bool running;          // measurement started and not yet evaluated
+  bool tainted;          // circuit open at the start (fails fast by design)
+  bool reset;            // silent sensor reset in a continuous fixed mode (not detectable)
+  bool faultPending;     // propertyFault set and not yet evaluated
+  unsigned long faultMark; // injected faults when propertyFault was set
+  unsigned long start;   // us
+  unsigned long changed; // last light change (us)
+  unsigned long transactions;
+  unsigned long faults;
+  uint8_t powerDowns;
+  uint8_t op;
+  }
+  sim_property_run_t;
+
+static bh1750_sim_fault_step_t propertyFault;
+
+static uint8_t propertyByte(sim_property_run_t& r) {
+  return r.pos<r.size ? r.data[r.pos++] : 0;
+}
+
+/**
+ * Light level of an argument byte: 0.1 .. 50000 lx, logarithmic.
+ */
+static float propertyLevel(uint8_t b) {
+  float lux = 0.1f * powf(10, b*5.7f/255);
+  return lux<50000 ? lux : 50000;
+}
+
+/**
+ * Max. conversion time of a measurement of the run (us): wake-up, probe and measurement
+ * with the longest measurement time, plus a bus timeout per transaction.
+ */
+static unsigned long propertyMaxTime(const sim_property_run_t& r) {
+  unsigned long ms = 3*BH1750_SETTLE_TIME + SIM_PROPERTY_MAX_TRANSACTIONS*(BH1750_BUS_TIMEOUT/1000+1);
+  if(r.mode==RESOLUTION_AUTO_HIGH) {
+    ms += bh1750MeasurementTime(BH1750_MTREG_DEFAULT, true) + bh1750MeasurementTime(BH1750_MTREG_MAX, false);
+  } else {
+    ms += bh1750MeasurementTime(BH1750_MTREG_DEFAULT, r.mode==RESOLUTION_LOW);
+  }
+  return ms*1000;
+}
+
+static void propertyViolation(sim_property_run_t& r, unsigned long& counter, const char* what, float lux) {
+  counter++;
+  if(r.log!=NULL) {
+    fprintf(r.log, "run %lu op %u: %s (mode %u apd %u level %.2f lx result %.2f lx bus %lu)\n",
+      r.result->runs, r.op, what, r.mode, r.autoPowerDown, r.scene.level, lux,
+      BH1750Sim.transactions()-r.transactions);
+  }
+}
+
+/**
+ * Notes a silent sensor reset by the last scripted fault (continuous fixed modes only:
+ * the sensor keeps delivering its last value, the driver cannot notice it).
+ */
+static void propertyCheckReset(sim_property_run_t& r) {
+  if(!r.faultPending || BH1750Sim.injectedFaults()==r.faultMark) {
+    return;
+  }
+  r.faultPending = false;
+  if(propertyFault.fault==SIM_FAULT_POWER_DOWN && !r.autoPowerDown && r.mode!=RESOLUTION_AUTO_HIGH) {
+    r.reset = true;
+  }
+}
+
+static void propertyStart(sim_property_run_t& r) {
+  r.running = true;
+  r.tainted = r.sensor->isCircuitOpen();
+  r.start = BH1750Sim.micros();
+  r.transactions = BH1750Sim.transactions();
+  r.faults = BH1750Sim.injectedFaults();
+  r.powerDowns = 0;
+}
+
+/**
+ * Checks the invariants of a finished measurement.
+ */
+static void propertyFinish(sim_property_run_t& r, float lux) {
+  r.running = false;
+  r.result->measurements++;
+  if(BH1750Sim.transactions()-r.transactions > SIM_PROPERTY_MAX_TRANSACTIONS*(1UL+r.powerDowns)+r.powerDowns) {
+    propertyViolation(r, r.result->busOverrun, "too many bus transactions", lux);
+  }
+  bool faulted = BH1750Sim.injectedFaults()!=r.faults;
+  bool continuous = !r.autoPowerDown && r.mode!=RESOLUTION_AUTO_HIGH;
+  propertyCheckReset(r);
+  if(faulted || r.tainted) {
+    return;
+  }
+  if(lux<0) {
+    propertyViolation(r, r.result->spurious, "error without fault", lux);
+    return;
+  }
+  unsigned long settle = continuous ? SIM_PROPERTY_SETTLE : 0;
+  if(r.reset || r.changed+settle>r.start) {
+    return; // light changed during the measurement
+  }
+  float level = r.scene.level;
+  if(r.mode==RESOLUTION_HIGH && level>=27000) {
+    return; // saturated by design (range 0-27306 lx)
+  }
+  if(fabs(lux-level)>level*0.02f+4) {
+    propertyViolation(r, r.result->inconsistent, "result differs from the light", lux);
+  }
+}
+
+/**
+ * Polls the running measurement at its due times until it has finished.
+ */
+static void propertyDrain(sim_property_run_t& r) {
+  if(!r.running) {
+    return;
+  }
+  unsigned long t0 = BH1750Sim.micros();
+  // after an interruption (powerDown), the wait of the interrupted stage runs first
+  unsigned long maxTime = propertyMaxTime(r) * (r.powerDowns>0 ? 2 : 1);
+  for(uint8_t i=0; i<SIM_PROPERTY_MAX_POLLS; i++) {
+    if(r.sensor->isMeasurementReady()) {
+      if(BH1750Sim.micros()-t0>maxTime) {
+        propertyViolation(r, r.result->nonTerminating, "measurement exceeds the max. conversion time", 0);
+      }
+      propertyFinish(r, r.sensor->readLightLevelAsync());
+      return;
+    }
+    simDelay(r.sensor->nextDelay());
+  }
+  propertyViolation(r, r.result->nonTerminating, "measurement does not terminate", 0);
+  r.running = false;
+}
+
+void simPropertyRun(const uint8_t* data, size_t size, bh1750_sim_property_t* result, FILE* log) {
+  const sensors_resolution_t modes[] = { RESOLUTION_LOW, RESOLUTION_NORMAL, RESOLUTION_HIGH, RESOLUTION_AUTO_HIGH };
+  const uint8_t faults[] = { SIM_FAULT_NACK_ADDRESS, SIM_FAULT_NACK_DATA, SIM_FAULT_SHORT_READ,
+    SIM_FAULT_CLOCK_STRETCH, SIM_FAULT_POWER_DOWN };
+  AS_BH1750A sensor;
+  sim_property_run_t r;
+  r.data = data;
+  r.size = size;
+  r.pos = 0;
+  r.result = result;
+  r.log = log;
+  r.sensor = &sensor;
+  uint8_t config = propertyByte(r);
+  r.mode = modes[config&3];
+  r.autoPowerDown = (config&4)!=0;
+  r.scene.name = "property";
+  r.scene.shape = SCENE_CONSTANT;
+  r.scene.level = propertyLevel(propertyByte(r));
+  r.scene.level2 = 0;
+  r.scene.time = 0;
+  r.scene.frequency = 0;
+  r.scene.depth = 0;
+  r.running = false;
+  r.tainted = false;
+  r.reset = false;
+  r.faultPending = false;
+  r.faultMark = 0;
+  r.changed = 0;
+  r.op = 0;
+  result->runs++;
+
+  BH1750Sim.reset(&r.scene);
+  sensor.begin(r.mode, r.autoPowerDown);
+
+  while(r.pos<r.size) {
+    uint8_t op = propertyByte(r) % PROPERTY_COUNT;
+    uint8_t arg;
+    float lux;
+    r.op++;
+    switch (op) {
+    case PROPERTY_START:
+      propertyStart(r);
+      sensor.startMeasurementAsync(&simMillis);
+      break;
+    case PROPERTY_POLL:
+      if(sensor.isMeasurementReady() && r.running) {
+        propertyFinish(r, sensor.readLightLevelAsync());
+      }
+      break;
+    case PROPERTY_READ:
+      lux = sensor.readLightLevelAsync();
+      if(lux!=-100 && r.running) {
+        propertyFinish(r, lux);
+      }
+      else if(lux==-100 && !r.running) {
+        propertyViolation(r, result->spurious, "running without start", lux);
+      }
+      break;
+    case PROPERTY_POWER_DOWN:
+      sensor.powerDown();
+      if(r.running) {
+        r.powerDowns++;
+      }
+      break;
+    case PROPERTY_CLOCK:
+      simDelay(propertyByte(r)*4UL);
+      break;
+    case PROPERTY_FAULT:
+      arg = propertyByte(r);
+      propertyCheckReset(r);
+      r.faultPending = true;
+      r.faultMark = BH1750Sim.injectedFaults();
+      propertyFault.transaction = BH1750Sim.transactions() + (arg/8)%4;
+      propertyFault.count = 1;
+      propertyFault.fault = faults[arg%5];
+      propertyFault.param = 50000;
+      BH1750Sim.setFaults(&propertyFault, 1);
+      break;
+    case PROPERTY_LEVEL:
+      r.scene.level = propertyLevel(propertyByte(r));
+      r.changed = BH1750Sim.micros();
+      break;
+    case PROPERTY_BLOCKING:
+    {
+      propertyStart(r);
+      lux = sensor.readLightLevel(&simDelay, &simMillis);
+      if(BH1750Sim.micros()-r.start>propertyMaxTime(r)) {
+        propertyViolation(r, result->nonTerminating, "blocking measurement exceeds the max. conversion time", lux);
+      }
+      propertyFinish(r, lux);
+      break;
+    }
+    default:
+      propertyDrain(r);
+      break;
+    }
+  }
+  propertyDrain(r);
+  BH1750Sim.setFaults(NULL, 0);
+}
+
+unsigned long simPropertyCheck(FILE* out, uint32_t seed, unsigned long runs) {
+  bh1750_sim_property_t r;
+  memset(&r, 0, sizeof(r));
+  uint32_t x = seed!=0 ? seed : 1;
+  uint8_t data[64];
+  for(unsigned long i=0; i<runs; i++) {
+    size_t size = 8 + i%(sizeof(data)-8);
+    for(size_t k=0; k<size; k++) {
+      // xorshift32
+      x ^= x<<13;
+      x ^= x>>17;
+      x ^= x<<5;
+      data[k] = x>>24;
+    }
+    unsigned long before = r.nonTerminating+r.busOverrun+r.inconsistent+r.spurious;
+    // log only the first violations
+    simPropertyRun(data, size, &r, before<10 ? out : NULL);
+  }
+  unsigned long violations = r.nonTerminating+r.busOverrun+r.inconsistent+r.spurious;
+  fprintf(out, "property check seed=%lu runs=%lu measurements=%lu non-terminating=%lu bus overrun=%lu inconsistent=%lu spurious=%lu\n",
+    (unsigned long)seed, r.runs, r.measurements, r.nonTerminating, r.busOverrun, r.inconsistent, r.spurious);
+  return violations;
+}
+
+// Darkness followed by daylight after 1 s for the MTreg change of the API benchmark (otherwise: faultScene)
+static const bh1750_scene_t apiStepScene = { "dark_to_day", SCENE_STEP, 1, 20000, 1000000, 0, 0 };
+
+static AS_BH1750* apiSensor;
+static AS_BH1750A* apiAsync;
+static sensors_resolution_t apiMode;
+static bool apiAutoPowerDown;
+
+/** One benchmarked path: preparation (not measured) and the measured call */
+typedef struct
+{
+  const char* path;
+  void (*setup)(void);
+  void (*run)(void);
+  }
+  sim_api_path_t;
+
+static void apiSetupReset(void) {
+  BH1750Sim.reset(&faultScene);
+}
+
+static void apiSetupReady(void) {
+  BH1750Sim.reset(&faultScene);
+  apiSensor->begin(apiMode, apiAutoPowerDown);
+  simDelay(1000);
+  apiSensor->readLightLevel(&simDelay); // steady state (range found, first conversion done)
+}
+
+static void apiSetupAsync(void) {
+  BH1750Sim.reset(&faultScene);
+  apiAsync->begin(apiMode, apiAutoPowerDown);
+  simDelay(1000);
+  apiAsync->readLightLevel(&simDelay);
+}
+
+static void apiSetupStep(void) {
+  BH1750Sim.reset(&apiStepScene);
+  apiSensor->begin(RESOLUTION_AUTO_HIGH, apiAutoPowerDown);
+  apiSensor->readLightLevel(&simDelay); // dark: max. MTreg
+  simDelay(2000);
+}
+
+static void apiBegin(void) {
+  apiSensor->begin(apiMode, apiAutoPowerDown);
+}
+
+static void apiIsPresent(void) {
+  apiSensor->isPresent();
+}
+
+static void apiRead(void) {
+  apiSensor->readLightLevel(&simDelay);
+}
+
+static void apiPowerDown(void) {
+  apiSensor->powerDown();
+}
+
+static void apiAsyncCycle(void) {
+  apiAsync->startMeasurementAsync(&simMillis);
+  while(!apiAsync->isMeasurementReady()) {
+    simDelay(apiAsync->nextDelay());
+  }
+  apiAsync->readLightLevelAsync();
+}
+
+/**
+ * Runs a path 'repetitions' times and prints its JSON object.
+ * The virtual metrics are taken from the first run, the CPU time is the minimum.
+ * CPU time and cycles cover the driver code: the time of the calls into the simulated
+ * sensor is measured separately (sim_cpu_ns) and subtracted.
+ */
+static void apiBenchPath(FILE* out, const sim_api_path_t& p, const char* mode, uint16_t repetitions, bool& first) {
+  unsigned long latency = 0, transactions = 0, bytes = 0, delayed = 0;
+  double cpuNs = 0;
+  double simNs = 0;
+  unsigned long long cycles = 0;
+  for(uint16_t r=0; r<repetitions; r++) {
+    p.setup();
+    unsigned long t0 = BH1750Sim.micros();
+    unsigned long tr0 = BH1750Sim.transactions();
+    unsigned long b0 = BH1750Sim.bytes();
+    unsigned long d0 = BH1750Sim.delayed();
+    double ns0, ns1;
+    unsigned long long c0, c1;
+    simCpuNs = 0;
+    simCpuCycles = 0;
+    simCpuActive = true;
+    simCpuNow(&ns0, &c0);
+    p.run();
+    simCpuNow(&ns1, &c1);
+    simCpuActive = false;
+    if(r==0) {
+      latency = BH1750Sim.micros()-t0;
+      transactions = BH1750Sim.transactions()-tr0;
+      bytes = BH1750Sim.bytes()-b0;
+      delayed = BH1750Sim.delayed()-d0;
+    }
+    double ns = ns1-ns0-simCpuNs;
+    unsigned long long c = c1-c0>simCpuCycles ? c1-c0-simCpuCycles : 0;
+    if(r==0 || ns<cpuNs) {
+      cpuNs = ns;
+      simNs = simCpuNs;
+    }
+    if(r==0 || c<cycles) {
+      cycles = c;
+    }
+  }
+  fprintf(out, "%s\n    {\"path\": \"%s\", \"mode\": \"%s\", \"autoPowerDown\": %s, \"latency_us\": %lu, \"transactions\": %lu, \"bytes\": %lu, \"delay_us\": %lu, \"cpu_ns\": %.0f, \"cpu_cycles\": %llu, \"sim_cpu_ns\": %.0f}",
+    first ? "" : ",", p.path, mode, apiAutoPowerDown ? "true" : "false", latency, transactions, bytes, delayed, cpuNs, cycles, simNs);
+  first = false;
+}
+
+void simApiBenchmark(FILE* out, uint16_t repetitions) {
+  const sensors_resolution_t modes[] = { RESOLUTION_LOW, RESOLUTION_NORMAL, RESOLUTION_HIGH, RESOLUTION_AUTO_HIGH };
+  const char* modeNames[] = { "LOW", "NORMAL", "HIGH", "AUTO_HIGH" };
+  const sim_api_path_t paths[] = {
+    { "begin", &apiSetupReset, &apiBegin },
+    { "isPresent", &apiSetupReady, &apiIsPresent },
+    { "readLightLevel", &apiSetupReady, &apiRead },
+    { "async", &apiSetupAsync, &apiAsyncCycle },
+    { "powerDown", &apiSetupReady, &apiPowerDown }
+  };
+  const sim_api_path_t mtregChange = { "mtregChange", &apiSetupStep, &apiRead };
+  AS_BH1750 sensor;
+  AS_BH1750A async;
+  apiSensor = &sensor;
+  apiAsync = &async;
+  if(repetitions==0) {
+    repetitions = 1;
+  }
+  bool first = true;
+  fprintf(out, "{\n  \"benchmark\": \"bh1750_api\",\n  \"repetitions\": %u,\n  \"results\": [", repetitions);
+  for(uint8_t p=0; p<sizeof(paths)/sizeof(paths[0]); p++) {
+    for(uint8_t m=0; m<sizeof(modes)/sizeof(modes[0]); m++) {
+      for(uint8_t apd=0; apd<2; apd++) {
+        apiMode = modes[m];
+        apiAutoPowerDown = apd==0;
+        apiBenchPath(out, paths[p], modeNames[m], repetitions, first);
+      }
+    }
+  }
+  for(uint8_t apd=0; apd<2; apd++) {
+    apiAutoPowerDown = apd==0;
+    apiBenchPath(out, mtregChange, "AUTO_HIGH", repetitions, first);
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Sim_h
+#define AS_BH1750Sim_h
+
+/*
+ Simulated BH1750 for host builds (BH1750_HOST defined).
+
+ The simulated sensor integrates a scripted light scene over the
+ MTreg-dependent measurement window and quantises the result like the
+ hardware modes. It offers the Wire interface used by the driver and a
+ virtual clock:
+   -DBH1750_HOST -DBH1750_WIRE=BH1750Sim -DBH1750_WIRE_HEADER='"AS_BH1750Sim.h"'
+ The delay and time functions of the driver must use the virtual clock
+ (simDelay, simMillis, simMicros).
+*/
+
+#ifdef BH1750_HOST
+
+#if (ARDUINO >= 100)
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#include <stdio.h>
+
+// The simulated bus offers the timeout interface of the AVR Wire library
+#ifndef WIRE_HAS_TIMEOUT
+#define WIRE_HAS_TIMEOUT
+#endif
+
+/** Shape of a light scene */
+typedef enum
+{
+  SCENE_CONSTANT = (0), /** constant level */
+  SCENE_STEP     = (1), /** level -> level2 at 'time' */
+  SCENE_RAMP     = (2), /** linear ramp level -> level2 within 'time' (sunrise) */
+  SCENE_FLICKER  = (3), /** level modulated with 'frequency' and 'depth' (mains lighting) */
+  SCENE_CLOUDS   = (4)  /** level with smooth random variation of 'depth', changing every 'time' */
+  }
+  bh1750_scene_shape_t;
+
+/** Light scene: lux over time */
+typedef struct
+{
+  const char* name;
+  bh1750_scene_shape_t shape;
+  float level;          /** lux */
+  float level2;         /** lux (STEP, RAMP) */
+  unsigned long time;   /** us (STEP: switching time, RAMP: duration, CLOUDS: correlation time) */
+  float frequency;      /** Hz (FLICKER) */
+  float depth;          /** relative modulation (FLICKER, CLOUDS) */
+  }
+  bh1750_scene_t;
+
+/** Predefined benchmark scenes */
+extern const bh1750_scene_t BH1750_SCENES[];
+extern const uint8_t BH1750_SCENE_COUNT;
+
+/**
+ * Returns the illuminance of a scene at the given time (us).
+ */
+float sceneLux(const bh1750_scene_t* scene, unsigned long us);
+
+/**
+ * Returns the mean illuminance of a scene in the interval [from, to) (us).
+ */
+float sceneMeanLux(const bh1750_scene_t* scene, unsigned long from, unsigned long to);
+
+/** Bus faults of the simulated sensor */
+typedef enum
+{
+  SIM_FAULT_NONE          = (0),
+  SIM_FAULT_NACK_ADDRESS  = (1), /** address not acknowledged (status 2, no data) */
+  SIM_FAULT_NACK_DATA     = (2), /** command byte not acknowledged (status 3), command lost */
+  SIM_FAULT_SHORT_READ    = (3), /** only one byte instead of two */
+  SIM_FAULT_CLOCK_STRETCH = (4), /** transaction delayed by 'param' us (times out if longer than the bus timeout) */
+  SIM_FAULT_BIT_FLIP      = (5), /** bit 'param' of the read value (0-15) or of the command byte (0-7) flipped */
+  SIM_FAULT_POWER_DOWN    = (6)  /** sensor resets to power down (running measurement lost), then the transaction */
+  }
+  bh1750_sim_fault_t;
+
+/** One step of a fault script */
+typedef struct
+{
+  unsigned long transaction; /** first affected bus transaction (value of transactions() before it) */
+  uint16_t count;            /** number of affected transactions */
+  uint8_t fault;             /** bh1750_sim_fault_t */
+  uint32_t param;            /** CLOCK_STRETCH: us, BIT_FLIP: bit number */
+  }
+  bh1750_sim_fault_step_t;
+
+/**
+ * Simulated BH1750 with virtual clock.
+ */
+class BH1750SimDevice {
+public:
+  BH1750SimDevice(uint8_t address = 0x23);
+
+  /**
+   * Sets the light scene and resets sensor and clock (power on state).
+   */
+  void reset(const bh1750_scene_t* scene);
+
+  /**
+   * Returns the current light scene.
+   */
+  const bh1750_scene_t* scene(void);
+
+  // Wire interface
+  void begin(void);
+  void beginTransmission(int address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(void);
+  uint8_t requestFrom(int address, int quantity);
+  int available(void);
+  int read(void);
+
+  // Timeout interface of the AVR Wire library (WIRE_HAS_TIMEOUT)
+  void setWireTimeout(uint32_t timeout = 25000, bool reset = false);
+  bool getWireTimeoutFlag(void);
+  void clearWireTimeoutFlag(void);
+
+  /**
+   * Stuck bus (a slave holds SDA low): every transaction fails after the timeout
+   * set with setWireTimeout (status 5 / no data). Without timeout, every transaction
+   * blocks SIM_HANG_TIME (10 s) of virtual time, which stands for a hang.
+   */
+  void setStuckBus(bool stuck);
+
+  /**
+   * Sets a fault script (array of steps, kept by the caller; NULL: no faults).
+   * Faults are counted in injectedFaults().
+   */
+  void setFaults(const bh1750_sim_fault_step_t* script, uint8_t count);
+
+  /**
+   * Number of transactions affected by a fault since reset.
+   */
+  unsigned long injectedFaults(void);
+
+  // Virtual clock
+  void delay(unsigned long ms);
+  void advance(unsigned long us);
+  unsigned long millis(void);
+  unsigned long micros(void);
+
+  /**
+   * Deviation of the internal clock of the sensor from the typical measurement time
+   * (e.g. 0.2: integrations take 20% longer; the datasheet allows up to +50%). Reset to 0 by reset().
+   */
+  void setClockDeviation(float deviation);
+
+  /**
+   * Integration time of the given hardware mode with the current MTreg and clock deviation (us).
+   */
+  unsigned long integrationTime(uint8_t mode);
+
+  /**
+   * True mean illuminance of the integration window of the current data register.
+   */
+  float dataTruth(void);
+
+  /**
+   * True while a measurement runs (continuous mode or an unfinished one-time measurement).
+   */
+  bool measuring(void);
+
+  /**
+   * Number of bus transactions (endTransmission and requestFrom) since reset.
+   */
+  unsigned long transactions(void);
+
+  /**
+   * Number of bytes moved on the bus (address and data bytes) since reset.
+   */
+  unsigned long bytes(void);
+
+  /**
+   * Virtual time spent in delay() since reset (us).
+   */
+  unsigned long delayed(void);
+
+private:
+  uint8_t _address;
+  const bh1750_scene_t* _scene;
+  unsigned long _now;
+  unsigned long _transactions;
+  unsigned long _bytes;
+  unsigned long _delayed;
+
+  // Sensor state
+  bool _powered;
+  uint8_t _mode;       // active measurement command, 0: none
+  uint8_t _MTreg;
+  uint8_t _activeMTreg; // MTreg of the running integration
+  unsigned long _start; // start of the running integration
+  float _deviation;     // clock deviation (setClockDeviation)
+  uint16_t _data;
+  float _truth;
+
+  // Bus state
+  int _txAddress;
+  uint8_t _txData[4];
+  uint8_t _txCount;
+  uint8_t _rxData[2];
+  uint8_t _rxCount;
+  uint8_t _rxPos;
+  bool _stuck;
+  uint32_t _timeout;
+  bool _timeoutFlag;
+  const bh1750_sim_fault_step_t* _faults;
+  uint8_t _faultCount;
+  unsigned long _injected;
+
+  bool stuck(void);
+  uint8_t activeFault(uint32_t& param);
+  bool stretch(uint32_t us);
+  void update(void);
+  void command(uint8_t cmd);
+};
+
+/**
+ * Global simulated sensor (use as BH1750_WIRE).
+ */
+extern BH1750SimDevice BH1750Sim;
+
+// Delay and time functions on the virtual clock of BH1750Sim.
+// Each time query costs 1 us of virtual time, so that busy waits terminate.
+void simDelay(unsigned long ms);
+unsigned long simMillis(void);
+unsigned long simMicros(void);
+
+/** Benchmark result of one scene */
+typedef struct
+{
+  const char* scene;
+  uint16_t readings;
+  float meanAbsError;  /** lux, against the true mean of the integration window */
+  float maxRelError;
+  unsigned long meanLatency; /** us */
+  unsigned long maxLatency;  /** us */
+  }
+  bh1750_sim_result_t;
+
+typedef float (*SimReadFuncPtr)(void);
+
+/**
+ * Runs the current scene of BH1750Sim against a read function (e.g. a configured sensor)
+ * and evaluates error and latency of the readings.
+ * Between readings, 'interval' ms of virtual time pass.
+ */
+bh1750_sim_result_t simRunScene(SimReadFuncPtr fReadPtr, uint16_t readings, unsigned long interval);
+
+/** Spectrum summary of a captured waveform */
+typedef struct
+{
+  float mean;          /** mean raw value */
+  float peakFrequency; /** frequency of the strongest component (Hz, aliased if above sampleRate/2) */
+  float peakAmplitude; /** amplitude of the strongest component (raw counts) */
+  float modulation;    /** peakAmplitude / mean */
+  }
+  bh1750_spectrum_t;
+
+/**
+ * Spectrum summary (DFT with Hann window) of a waveform captured with AS_BH1750::capture.
+ */
+bh1750_spectrum_t captureSpectrum(const uint16_t* raw, uint16_t count, float sampleRate);
+
+/**
+ * Runs all predefined scenes for all virtual modes of AS_BH1750
+ * and prints one line per scene and mode.
+ * Checks every reading against one quantisation step of the range in use (in the fixed modes
+ * plus the part of the light level above full scale, e.g. direct sun) and its latency against
+ * settling pause and measurement time of the range (in the automatic mode plus the probe).
+ * Returns the number of scenes and modes with a violation.
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+unsigned long simSceneBenchmark(FILE* out);
+
+/**
+ * Compares the core driver (AS_BH1750) with the header-only AS_BH1750Fixed
+ * for the same fixed modes: object size, host CPU time, bus transactions and
+ * virtual latency per measurement.
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+void simInlineBenchmark(FILE* out, uint16_t readings);
+
+/**
+ * Measures the worst-case latency of readLightLevel() on a stuck bus for all virtual modes
+ * with the given transaction timeout (us, see AS_BH1750Core::setBusTimeout), over 10 calls:
+ * results BH1750_TIMEOUT and -1 (circuit open after BH1750_BREAKER_THRESHOLD timeouts).
+ * Checks that no call blocks longer than one timeout and that the results follow the
+ * circuit breaker (timeouts, then rejected calls and recovery attempts with growing backoff).
+ * Returns the number of violations (extras/host/timeouts.cpp, make check).
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+unsigned long simStuckBusBenchmark(FILE* out, unsigned long timeout);
+
+/**
+ * Fault campaign: injects every fault type at every bus transaction of a measurement
+ * into AS_BH1750 and AS_BH1750A (RESOLUTION_NORMAL and RESOLUTION_AUTO_HIGH), without and with
+ * bus verification (AS_BH1750Core::setBusVerification), and prints per fault type and driver:
+ * correct, failed and wrong results, measurements that did not terminate, correct follow-up
+ * measurements and the max. latency. Checks that every measurement ends (DONE, ERROR or TIMEOUT)
+ * within its fault-free latency plus one bus timeout, that failures carry the error status
+ * (BH1750_MEASUREMENT_TIMEOUT for a stretched clock, otherwise BH1750_MEASUREMENT_ERROR) and no lux,
+ * and that no wrong value is valid and the next measurement is correct again (bit flips: only
+ * with verification). Returns the number of violations (extras/host/faults.cpp, make check).
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+unsigned long simFaultBenchmark(FILE* out);
+
+/** Result of the property check of the stage machine (simPropertyRun) */
+typedef struct
+{
+  unsigned long runs;
+  unsigned long measurements;   /** completed measurements */
+  unsigned long nonTerminating; /** not finished within the max. conversion time (after the last interruption) */
+  unsigned long busOverrun;     /** more bus transactions than a complete measurement needs */
+  unsigned long inconsistent;   /** result differs from the simulated light (no fault, stable light) */
+  unsigned long spurious;       /** error result without injected fault */
+  }
+  bh1750_sim_property_t;
+
+/**
+ * Property check of the stage machine: runs AS_BH1750A through the operations encoded in 'data'
+ * (start, poll, read, powerDown, blocking read, clock jumps, bus faults, light changes)
+ * and checks the invariants after every measurement. Violations are counted in 'result'
+ * and described on 'log' (or NULL).
+ * Every byte sequence is a valid input; extras/host/property.cpp is the libFuzzer target
+ * and the standalone check (make check, make fuzz in extras/host).
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+void simPropertyRun(const uint8_t* data, size_t size, bh1750_sim_property_t* result, FILE* log);
+
+/**
+ * Runs 'runs' random operation sequences (xorshift generator with 'seed') through simPropertyRun
+ * and prints the summary and the first violations. Returns the number of violations.
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+unsigned long simPropertyCheck(FILE* out, uint32_t seed, unsigned long runs);
+
+/**
+ * Benchmark of the public API paths: begin(), isPresent(), readLightLevel() in every virtual mode
+ * with and without auto power down, the asynchronous start/poll/read cycle, powerDown() and
+ * MTreg changes of the automatic mode. Prints one JSON document with, per path: virtual latency,
+ * bus transactions, bytes on the bus, time in blocking delays (all deterministic, so two runs
+ * can be diffed) and the host CPU time of the driver code (minimum of 'repetitions' runs;
+ * with cycles of the time stamp counter on x86). The time of the calls into the simulated
+ * sensor is measured around each call and subtracted (reported as sim_cpu_ns); the timer
+ * reads themselves add a few ns per bus or clock call.
+ * Requires BH1750_WIRE = BH1750Sim.
+ */
+void simApiBenchmark(FILE* out, uint16_t repetitions);
+
+#endif
+
+#endif
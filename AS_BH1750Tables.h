@@ -0,0 +1,136 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Tables_h
+#define AS_BH1750Tables_h
+
+#include "AS_BH1750Defs.h"
+
+/*
+ Lookup tables per MTreg value, generated at compile time from the datasheet formulas:
+ - lux per count (H-resolution): 1 / 1.2 * 69 / MTreg, fixed point Q15, rounded
+   (full scale at MTreg 69: 65535 counts = 54613 lx instead of 54612.5 lx with the exact factor)
+ - typical measurement time: 120 ms (H-resolution) or 16 ms (L-resolution) at MTreg 69, proportional to MTreg
+ On AVR, the tables are located in flash (PROGMEM).
+*/
+
+// Fixed point format of the scale table
+#define BH1750_SCALE_SHIFT 15
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define BH1750_READ_WORD(p) pgm_read_word(p)
+#define BH1750_READ_BYTE(p) pgm_read_byte(p)
+#else
+#define BH1750_READ_WORD(p) (*(p))
+#define BH1750_READ_BYTE(p) (*(p))
+#endif
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+/** lux per count (H-resolution) in Q15, rounded: 69 / (1.2 * MTreg) * 2^15 */
+constexpr uint16_t bh1750ScaleQ15(uint16_t mtreg) {
+  return (uint16_t)(((uint32_t)BH1750_MTREG_DEFAULT * (10UL << BH1750_SCALE_SHIFT) + 6UL * mtreg) / (12UL * mtreg));
+}
+
+/** Typical measurement time in H-resolution (ms, rounded up) */
+constexpr uint16_t bh1750TimeHigh(uint16_t mtreg) {
+  return (uint16_t)((120UL * mtreg + BH1750_MTREG_DEFAULT - 1) / BH1750_MTREG_DEFAULT);
+}
+
+/** Typical measurement time in L-resolution (ms, rounded up) */
+constexpr uint8_t bh1750TimeLow(uint16_t mtreg) {
+  return (uint8_t)((16UL * mtreg + BH1750_MTREG_DEFAULT - 1) / BH1750_MTREG_DEFAULT);
+}
+
+// Index sequence 0..N-1 for the table generation
+template <uint8_t... I> struct BH1750Seq {};
+template <uint8_t N, uint8_t... I> struct BH1750MakeSeq : BH1750MakeSeq<N-1, N-1, I...> {};
+template <uint8_t... I> struct BH1750MakeSeq<0, I...> { typedef BH1750Seq<I...> type; };
+
+template <class Seq> struct BH1750Tables;
+template <uint8_t... I> struct BH1750Tables<BH1750Seq<I...> > {
+  static const uint16_t scale[sizeof...(I)];
+  static const uint16_t timeHigh[sizeof...(I)];
+  static const uint8_t timeLow[sizeof...(I)];
+};
+
+template <uint8_t... I> const uint16_t BH1750Tables<BH1750Seq<I...> >::scale[sizeof...(I)] PROGMEM = { bh1750ScaleQ15(BH1750_MTREG_MIN+I)... };
+template <uint8_t... I> const uint16_t BH1750Tables<BH1750Seq<I...> >::timeHigh[sizeof...(I)] PROGMEM = { bh1750TimeHigh(BH1750_MTREG_MIN+I)... };
+template <uint8_t... I> const uint8_t BH1750Tables<BH1750Seq<I...> >::timeLow[sizeof...(I)] PROGMEM = { bh1750TimeLow(BH1750_MTREG_MIN+I)... };
+
+typedef BH1750Tables<BH1750MakeSeq<BH1750_MTREG_MAX-BH1750_MTREG_MIN+1>::type> BH1750Table;
+
+/**
+ * lux per count (H-resolution) in Q15 for a valid MTreg (BH1750_MTREG_MIN..BH1750_MTREG_MAX).
+ */
+inline uint16_t bh1750Scale(uint8_t mtreg) {
+  return BH1750_READ_WORD(&BH1750Table::scale[mtreg-BH1750_MTREG_MIN]);
+}
+
+/**
+ * Typical measurement time (ms) for a valid MTreg in H-resolution (lowRes = false) or L-resolution.
+ */
+inline uint16_t bh1750MeasurementTime(uint8_t mtreg, bool lowRes) {
+  if(lowRes) {
+    return BH1750_READ_BYTE(&BH1750Table::timeLow[mtreg-BH1750_MTREG_MIN]);
+  }
+  return BH1750_READ_WORD(&BH1750Table::timeHigh[mtreg-BH1750_MTREG_MIN]);
+}
+
+/**
+ * Light level (lux) of a raw value measured with a valid MTreg in the given hardware mode
+ * (the conversion of the drivers). H-resolution mode 2 (0x11, 0x21) has half the lux per count.
+ */
+inline float bh1750Lux(uint16_t raw, uint8_t mtreg, uint8_t mode) {
+  uint32_t level = (uint32_t)raw * bh1750Scale(mtreg);
+  return level * ((mode&0x0F)==0x01 ? 1.0f / (2UL << BH1750_SCALE_SHIFT) : 1.0f / (1UL << BH1750_SCALE_SHIFT));
+}
+
+/**
+ * Smallest raw value whose light level (bh1750Lux) reaches the given lux threshold
+ * with a valid MTreg in the given hardware mode, so that
+ * raw >= bh1750RawThreshold(lux, ..) exactly matches bh1750Lux(raw, ..) >= lux.
+ * Thresholds above the range yield 0xFFFF (reached only when saturated).
+ */
+inline uint16_t bh1750RawThreshold(float lux, uint8_t mtreg, uint8_t mode) {
+  if(!(lux>0)) {
+    return 0;
+  }
+  // estimate from the inverse formula, then correct the rounding of the conversion
+  float estimate = lux * ((mode&0x0F)==0x01 ? (2UL << BH1750_SCALE_SHIFT) : (1UL << BH1750_SCALE_SHIFT)) / bh1750Scale(mtreg);
+  uint32_t raw = estimate<65535 ? (uint32_t)estimate : 65535;
+  while(raw>0 && bh1750Lux(raw-1, mtreg, mode)>=lux) {
+    raw--;
+  }
+  while(raw<65535 && bh1750Lux(raw, mtreg, mode)<lux) {
+    raw++;
+  }
+  return raw;
+}
+
+#endif
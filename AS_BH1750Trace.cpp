@@ -0,0 +1,172 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Trace.h"
+
+/**
+ * Constructor.
+ * The events are not copied, the buffer must remain valid during the replay.
+ */
+BH1750TraceReplay::BH1750TraceReplay(const bh1750_trace_event_t* events, uint16_t count) {
+  _events = events;
+  _count = count;
+  rewind();
+}
+
+void BH1750TraceReplay::rewind(void) {
+  _pos = 0;
+  _transactions = 0;
+  _mismatches = 0;
+  _pending = 0;
+  _now = 0;
+  _clock = 0;
+}
+
+/**
+ * Takes the next event from the trace.
+ * If the type or the checked arguments (arg and detail) do not match, the replay resynchronises:
+ * the first matching event within the next BH1750_TRACE_RESYNC events is taken,
+ * the events before it were left out by the driver and are skipped.
+ * Without such an event, an event of the same type is taken as it is (different argument),
+ * otherwise the call is additional and the position is kept (NULL is returned).
+ * Every deviation is counted as a mismatch.
+ */
+const bh1750_trace_event_t* BH1750TraceReplay::next(uint8_t type, uint8_t arg, bool checkArg, uint8_t detail) {
+  if(_pos>=_count) {
+    _mismatches++;
+    return NULL;
+  }
+  uint16_t pos = _pos;
+  if(_events[pos].type!=type || (checkArg && (_events[pos].arg!=arg || _events[pos].detail!=detail))) {
+    _mismatches++;
+    for(uint16_t i=pos+1; i<_count && i<=_pos+BH1750_TRACE_RESYNC; i++) {
+      if(_events[i].type==type && (!checkArg || (_events[i].arg==arg && _events[i].detail==detail))) {
+        pos = i;
+        break;
+      }
+    }
+    if(_events[pos].type!=type) {
+      return NULL;
+    }
+  }
+  const bh1750_trace_event_t* e = &_events[pos];
+  _pos = pos+1;
+  if(type!=BH1750_TRACE_CLOCK) {
+    _now = e->time;
+  }
+  return e;
+}
+
+void BH1750TraceReplay::begin(void) {
+  next(BH1750_TRACE_BUS_BEGIN, 0, false);
+}
+
+void BH1750TraceReplay::beginTransmission(int address) {
+  next(BH1750_TRACE_BEGIN, address, true);
+}
+
+size_t BH1750TraceReplay::write(uint8_t data) {
+  const bh1750_trace_event_t* e = next(BH1750_TRACE_WRITE, data, true);
+  return e!=NULL ? e->result : 0;
+}
+
+uint8_t BH1750TraceReplay::endTransmission(void) {
+  _transactions++;
+  const bh1750_trace_event_t* e = next(BH1750_TRACE_END, 0, false);
+  return e!=NULL ? e->result : 4; // 4: other error
+}
+
+uint8_t BH1750TraceReplay::requestFrom(int address, int quantity) {
+  _transactions++;
+  const bh1750_trace_event_t* e = next(BH1750_TRACE_REQUEST, quantity, true, address);
+  _pending = e!=NULL ? e->result : 0;
+  return _pending;
+}
+
+int BH1750TraceReplay::available(void) {
+  return _pending;
+}
+
+int BH1750TraceReplay::read(void) {
+  const bh1750_trace_event_t* e = next(BH1750_TRACE_READ, 0, false);
+  if(e==NULL || (e->detail&BH1750_TRACE_NO_DATA)) {
+    return -1;
+  }
+  if(_pending>0) {
+    _pending--;
+  }
+  return e->result;
+}
+
+unsigned long BH1750TraceReplay::clock(void) {
+  const bh1750_trace_event_t* e = next(BH1750_TRACE_CLOCK, 0, false);
+  if(e!=NULL) {
+    _clock = e->time;
+  }
+  return _clock;
+}
+
+unsigned long BH1750TraceReplay::now(void) {
+  return _now;
+}
+
+uint16_t BH1750TraceReplay::transactions(void) {
+  return _transactions;
+}
+
+uint16_t BH1750TraceReplay::mismatches(void) {
+  return _mismatches;
+}
+
+bool BH1750TraceReplay::finished(void) {
+  return _pos>=_count;
+}
+
+#ifdef BH1750_HOST
+bool saveTrace(FILE* file, const bh1750_trace_event_t* events, uint16_t count) {
+  bh1750_trace_header_t header;
+  header.magic = BH1750_TRACE_MAGIC;
+  header.version = BH1750_TRACE_VERSION;
+  header.eventSize = sizeof(bh1750_trace_event_t);
+  header.count = count;
+  if(fwrite(&header, sizeof(header), 1, file)!=1) {
+    return false;
+  }
+  return fwrite(events, sizeof(bh1750_trace_event_t), count, file)==count;
+}
+
+uint16_t loadTrace(FILE* file, bh1750_trace_event_t* buffer, uint16_t size) {
+  bh1750_trace_header_t header;
+  if(fread(&header, sizeof(header), 1, file)!=1) {
+    return 0;
+  }
+  if(header.magic!=BH1750_TRACE_MAGIC || header.version!=BH1750_TRACE_VERSION || header.eventSize!=sizeof(bh1750_trace_event_t)) {
+    return 0;
+  }
+  uint32_t n = header.count<size ? header.count : size;
+  return fread(buffer, sizeof(bh1750_trace_event_t), n, file);
+}
+#endif
@@ -0,0 +1,282 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef AS_BH1750Trace_h
+#define AS_BH1750Trace_h
+
+#if (ARDUINO >= 100)
+#include <Arduino.h>
+#else
+#include <WProgram.h>
+#endif
+
+#ifdef BH1750_HOST
+#include <stdio.h>
+#endif
+
+/*
+ Trace record and replay of all bus transactions and clock queries of the driver.
+
+ Recording: wrap the real (or simulated) bus into a BH1750TraceRecorder and let
+ the driver use it (see BH1750_WIRE in AS_BH1750.h). Clock queries are recorded
+ by routing the TimeFuncPtr of the driver through the recorder, e.g.:
+   unsigned long tracedMillis() { return recorder.clock(&millis); }
+
+ Replay: use a BH1750TraceReplay as BH1750_WIRE. It feeds the recorded responses
+ back to the unmodified driver and counts transactions and deviations.
+
+ Trace file: bh1750_trace_header_t followed by 'count' bh1750_trace_event_t
+ (raw structs, host byte order). The file functions are only available in
+ host builds (BH1750_HOST defined).
+*/
+
+// Trace file identification
+#define BH1750_TRACE_MAGIC 0x54484231UL // "1BHT"
+#define BH1750_TRACE_VERSION 2
+
+// Event types
+// Bus initialization (begin)
+#define BH1750_TRACE_BUS_BEGIN 0x01
+// beginTransmission: arg = address
+#define BH1750_TRACE_BEGIN 0x02
+// write: arg = data byte
+#define BH1750_TRACE_WRITE 0x03
+// endTransmission: result = status
+#define BH1750_TRACE_END 0x04
+// requestFrom: arg = requested bytes, result = received bytes, detail = address
+#define BH1750_TRACE_REQUEST 0x05
+// read: result = data byte, detail = BH1750_TRACE_NO_DATA if no byte was available (-1)
+#define BH1750_TRACE_READ 0x06
+// Clock query: time = returned value
+#define BH1750_TRACE_CLOCK 0x07
+
+// Detail of a read event: the bus returned -1 (result is then 0)
+#define BH1750_TRACE_NO_DATA 0x01
+
+// Replay: max. number of recorded events skipped to resynchronise after a deviating call
+#define BH1750_TRACE_RESYNC 8
+
+/** One recorded event (8 bytes). */
+typedef struct
+{
+  uint32_t time;   /** Timestamp of the recorder clock (for BH1750_TRACE_CLOCK: the returned value). */
+  uint8_t type;    /** Event type (BH1750_TRACE_...). */
+  uint8_t arg;     /** Argument of the call. */
+  uint8_t result;  /** Response of the bus. */
+  uint8_t detail;  /** Second argument or response flag (see event types), otherwise 0. */
+  }
+  bh1750_trace_event_t;
+
+/** Header of a trace file. */
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t eventSize;
+  uint32_t count;
+  }
+  bh1750_trace_header_t;
+
+typedef unsigned long (*TraceTimeFuncPtr)(void);
+
+/**
+ * Records all calls to a bus with Wire interface into a caller-provided buffer.
+ * The calls are forwarded unchanged to the wrapped bus.
+ */
+template <class Bus>
+class BH1750TraceRecorder {
+public:
+  /**
+   * Constructor.
+   * - bus: the real (or simulated) bus.
+   * - buffer, size: memory for the events. If full, further events are dropped (see overflow()).
+   * - fTimePtr: timestamp source, e.g. micros.
+   */
+  BH1750TraceRecorder(Bus& bus, bh1750_trace_event_t* buffer, uint16_t size, TraceTimeFuncPtr fTimePtr)
+    : _bus(bus), _buffer(buffer), _size(size), _count(0), _overflow(false), _fTimePtr(fTimePtr) {}
+
+  void begin(void) {
+    _bus.begin();
+    record(BH1750_TRACE_BUS_BEGIN, 0, 0);
+  }
+
+  void beginTransmission(int address) {
+    _bus.beginTransmission(address);
+    record(BH1750_TRACE_BEGIN, address, 0);
+  }
+
+  size_t write(uint8_t data) {
+    size_t n = _bus.write(data);
+    record(BH1750_TRACE_WRITE, data, n);
+    return n;
+  }
+
+  uint8_t endTransmission(void) {
+    uint8_t status = _bus.endTransmission();
+    record(BH1750_TRACE_END, 0, status);
+    return status;
+  }
+
+  uint8_t requestFrom(int address, int quantity) {
+    uint8_t n = _bus.requestFrom(address, quantity);
+    record(BH1750_TRACE_REQUEST, quantity, n, address);
+    return n;
+  }
+
+  int available(void) {
+    return _bus.available();
+  }
+
+  int read(void) {
+    int data = _bus.read();
+    record(BH1750_TRACE_READ, 0, data<0 ? 0 : data, data<0 ? BH1750_TRACE_NO_DATA : 0);
+    return data;
+  }
+
+  /**
+   * Queries the given clock and records the returned value.
+   */
+  unsigned long clock(TraceTimeFuncPtr fTimePtr) {
+    unsigned long t = fTimePtr();
+    if(_count<_size) {
+      bh1750_trace_event_t& e = _buffer[_count++];
+      e.time = t;
+      e.type = BH1750_TRACE_CLOCK;
+      e.arg = 0;
+      e.result = 0;
+      e.detail = 0;
+    } else {
+      _overflow = true;
+    }
+    return t;
+  }
+
+  const bh1750_trace_event_t* events(void) const { return _buffer; }
+  uint16_t count(void) const { return _count; }
+  bool overflow(void) const { return _overflow; }
+  void clear(void) { _count = 0; _overflow = false; }
+
+private:
+  Bus& _bus;
+  bh1750_trace_event_t* _buffer;
+  uint16_t _size;
+  uint16_t _count;
+  bool _overflow;
+  TraceTimeFuncPtr _fTimePtr;
+
+  void record(uint8_t type, uint8_t arg, uint8_t result, uint8_t detail = 0) {
+    if(_count>=_size) {
+      _overflow = true;
+      return;
+    }
+    bh1750_trace_event_t& e = _buffer[_count++];
+    e.time = _fTimePtr();
+    e.type = type;
+    e.arg = arg;
+    e.result = result;
+    e.detail = detail;
+  }
+};
+
+/**
+ * Plays a recorded trace back. Offers the Wire interface used by the driver
+ * and returns the recorded responses in the recorded order.
+ * A call that does not match the next event (type or arguments) is counted (mismatches())
+ * and resynchronised within the next BH1750_TRACE_RESYNC events: recorded events left out
+ * by the driver are skipped. Without a matching event, the recorded response of an event
+ * of the same type is delivered nevertheless; a call of another type is additional,
+ * gets no response (0, or 4 from endTransmission) and keeps the trace position.
+ * Left out sequences longer than the look-ahead, or additional calls whose type follows
+ * within it, shift the responses until the next resynchronisation.
+ */
+class BH1750TraceReplay {
+public:
+  BH1750TraceReplay(const bh1750_trace_event_t* events, uint16_t count);
+
+  void begin(void);
+  void beginTransmission(int address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(void);
+  uint8_t requestFrom(int address, int quantity);
+  int available(void);
+  int read(void);
+
+  /**
+   * Returns the next recorded clock value.
+   */
+  unsigned long clock(void);
+
+  /**
+   * Restarts the replay from the first event and resets the counters.
+   */
+  void rewind(void);
+
+  /**
+   * Timestamp of the last replayed event (virtual time of the replay).
+   */
+  unsigned long now(void);
+
+  /**
+   * Number of completed bus transactions (endTransmission and requestFrom).
+   */
+  uint16_t transactions(void);
+
+  /**
+   * Number of calls that did not match the trace.
+   */
+  uint16_t mismatches(void);
+
+  /**
+   * Indicates whether all events have been replayed.
+   */
+  bool finished(void);
+
+private:
+  const bh1750_trace_event_t* _events;
+  uint16_t _count;
+  uint16_t _pos;
+  uint16_t _transactions;
+  uint16_t _mismatches;
+  uint8_t _pending;
+  unsigned long _now;
+  unsigned long _clock;
+
+  const bh1750_trace_event_t* next(uint8_t type, uint8_t arg, bool checkArg, uint8_t detail = 0);
+};
+
+#ifdef BH1750_HOST
+/**
+ * Writes a trace file (host only).
+ */
+bool saveTrace(FILE* file, const bh1750_trace_event_t* events, uint16_t count);
+
+/**
+ * Reads a trace file (host only). Returns the number of events read into the buffer.
+ */
+uint16_t loadTrace(FILE* file, bh1750_trace_event_t* buffer, uint16_t size);
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+/*
+ Wire interface for the host and size builds (defined in host.cpp or size_stubs.cpp,
+ out of line like the Wire library of the Arduino cores). requestFrom is overloaded
+ for uint8_t and int like in the AVR core, so calls that are ambiguous there fail here too. The host builds use the
+ simulated bus (BH1750_WIRE = BH1750Sim), so there this bus is never addressed.
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+class TwoWire {
+public:
+  void begin(void);
+  void beginTransmission(int address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(void);
+  uint8_t requestFrom(uint8_t address, uint8_t quantity);
+  uint8_t requestFrom(int address, int quantity);
+  int available(void);
+  int read(void);
+};
+
+extern TwoWire Wire;
+
+#endif
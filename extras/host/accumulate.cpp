@@ -0,0 +1,115 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Sim.h"
+#include "AS_BH1750.h"
+
+/*
+ Low-light accumulation (accumulate) on a sensor whose clock deviates from the typical
+ measurement time by -20%, 0 and +20%: each integration must be accumulated exactly once,
+ i.e. the call ends with the last of 'count' integrations, the measured period matches
+ the simulated one and the mean matches the true mean light level of the integrations
+ within ACCUMULATE_ERRORS standard errors.
+ Darkness (no visible end) must terminate after count/(1+deviation) integrations (+-1)
+ with the mean within the same bound; a delay that overruns the period must be reported
+ as missed integrations.
+ Exits with 1 on a violation.
+*/
+
+#define ACCUMULATE_COUNT 64
+// bound of the deviation from the true mean (standard errors)
+#define ACCUMULATE_ERRORS 3
+// integration where the overrunning delay function blocks for 1 s
+#define ACCUMULATE_OVERRUN 20
+
+static const bh1750_scene_t accumulateScenes[] = {
+  // name           shape           level   level2   time      freq  depth
+  { "constant_1lx", SCENE_CONSTANT, 1.0,    0,       0,        0,    0   },
+  { "clouds_0.5lx", SCENE_CLOUDS,   0.5,    0,       3000000,  0,    0.3 },
+  { "ramp_0.2lx",   SCENE_RAMP,     0.2,    0.4,     20000000, 0,    0   },
+  { "darkness",     SCENE_CONSTANT, 0,      0,       0,        0,    0   }
+};
+
+static const float accumulateDeviations[] = { -0.2, 0, 0.2 };
+
+static unsigned long overrunCalls;
+
+static void overrunDelay(unsigned long ms) {
+  overrunCalls++;
+  simDelay(overrunCalls==ACCUMULATE_OVERRUN*BH1750_ACCUMULATE_PERIOD/1000/BH1750_ACCUMULATE_POLL ? 1000 : ms);
+}
+
+/**
+ * One accumulation after a reading in the automatic mode. Returns false on a violation.
+ */
+static bool run(const bh1750_scene_t* scene, float deviation, DelayFuncPtr fDelayPtr, bool overrun) {
+  AS_BH1750 sensor;
+  BH1750Sim.reset(scene);
+  BH1750Sim.setClockDeviation(deviation);
+  sensor.begin(RESOLUTION_AUTO_HIGH, true);
+  sensor.readLightLevel(&simDelay);
+
+  bh1750_accumulation_t a;
+  overrunCalls = 0;
+  unsigned long t0 = BH1750Sim.micros();
+  bool ok = sensor.accumulate(ACCUMULATE_COUNT, &a, fDelayPtr, &simMicros);
+  unsigned long elapsed = BH1750Sim.micros()-t0;
+  // the one-time mode is restored without starting a measurement
+  bool idle = !BH1750Sim.measuring();
+
+  // simulated period and the integrations that ended during the call
+  unsigned long period = (unsigned long)(BH1750_ACCUMULATE_PERIOD * (1.0 + deviation));
+  unsigned long ended = elapsed / period;
+  bool dark = scene->level==0;
+  float truth = sceneMeanLux(scene, t0, t0 + (ACCUMULATE_COUNT+a.missed)*period);
+  // darkness: the integrations are counted from the typical period
+  float drifted = ACCUMULATE_COUNT / (1.0 + deviation);
+
+  bool valid = ok && idle && a.samples==ACCUMULATE_COUNT && fabs(a.lux-truth) <= ACCUMULATE_ERRORS*a.error;
+  if(dark) {
+    valid = valid && a.observed==0 && fabs(ended-drifted) <= 1;
+  } else {
+    valid = valid && ended==(unsigned long)ACCUMULATE_COUNT+a.missed
+      && fabs((float)a.period-period) < period*0.01
+      && (overrun ? a.missed>0 : a.missed==0);
+  }
+  printf("%-13s %+3.0f%% %s ok=%d samples=%u observed=%u missed=%u period=%lu us (sensor %lu) "
+    "integrations=%lu lux=%.4f truth=%.4f error=%.4f idle=%d %s\n",
+    scene->name, deviation*100, overrun ? "overrun" : "       ", ok, a.samples, a.observed, a.missed,
+    a.period, period, ended, a.lux, truth, a.error, idle, valid ? "ok" : "VIOLATION");
+  return valid;
+}
+
+int main(void) {
+  bool ok = true;
+  for(uint8_t s=0; s<sizeof(accumulateScenes)/sizeof(accumulateScenes[0]); s++) {
+    for(uint8_t d=0; d<sizeof(accumulateDeviations)/sizeof(accumulateDeviations[0]); d++) {
+      ok = run(&accumulateScenes[s], accumulateDeviations[d], &simDelay, false) && ok;
+    }
+  }
+  ok = run(&accumulateScenes[1], 0.2, &overrunDelay, true) && ok;
+  return ok ? 0 : 1;
+}
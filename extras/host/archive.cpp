@@ -0,0 +1,358 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "AS_BH1750Archive.h"
+#include "AS_BH1750Tables.h"
+
+/*
+ Columnar archive (AS_BH1750Archive.h) against a brute-force scan of the written records:
+ - round trip: random records (out-of-order timestamps, invalid status and MTreg, both
+   append variants) over several segments, reopened by the writer and continued;
+   record count and every segment index must match the records,
+ - query() and range() of random windows (also empty, the whole archive and truncated
+   to a small buffer) must return the same records, in the stored order, and the same
+   light levels (bit-exact with bh1750Lux) as the scan,
+ - a writer process appends while the reader queries: every query must return
+   a complete prefix of the records, the reader must follow the growing file
+   and see it at least once during the writing.
+ Then the archive benchmark (archiveBenchmark).
+ Exits with 1 on a violation.
+*/
+
+#define ARCHIVE_PATH "archive_test.bha"
+#define ARCHIVE_BENCH_PATH "archive_bench.bha"
+// records of the round trip (3.5 segments) and of the concurrent writer
+#define ARCHIVE_RECORDS (BH1750_ARCHIVE_RECORDS * 7 / 2)
+#define ARCHIVE_CONCURRENT_RECORDS (BH1750_ARCHIVE_RECORDS * 3 + 100)
+#define ARCHIVE_QUERIES 2000
+// records of the benchmark: one week, one per second
+#define ARCHIVE_BENCH_RECORDS (7UL * 86400)
+
+typedef struct
+{
+  uint64_t time;
+  uint16_t raw;
+  uint8_t MTreg;
+  uint8_t mode;
+  uint8_t status;
+  }
+  archive_record_t;
+
+static uint32_t archiveSeed = 0x9E3779B9UL;
+
+static uint32_t archiveRandom(void) {
+  archiveSeed ^= archiveSeed << 13;
+  archiveSeed ^= archiveSeed >> 17;
+  archiveSeed ^= archiveSeed << 5;
+  return archiveSeed;
+}
+
+static bool sameFloat(float a, float b) {
+  return memcmp(&a, &b, sizeof(float))==0;
+}
+
+/**
+ * Whether the archive reports a stored record (valid status and MTreg).
+ */
+static bool archiveValid(const archive_record_t& r) {
+  return (r.status&BH1750_MEASUREMENT_VALID) && r.MTreg>=BH1750_MTREG_MIN && r.MTreg<=BH1750_MTREG_MAX;
+}
+
+/**
+ * Random record i: timestamps ascending with jitter (partly out of order), every 16th
+ * with an error status, some with an invalid MTreg; odd ones appended as bh1750_record_t.
+ */
+static archive_record_t archiveRecord(uint32_t i) {
+  const uint8_t modes[] = { BH1750_ONE_TIME_HIGH_RES_MODE, BH1750_ONE_TIME_HIGH_RES_MODE_2, BH1750_ONE_TIME_LOW_RES_MODE,
+    BH1750_CONTINUOUS_HIGH_RES_MODE, BH1750_CONTINUOUS_HIGH_RES_MODE_2, BH1750_CONTINUOUS_LOW_RES_MODE };
+  archive_record_t r;
+  uint32_t x = archiveRandom();
+  r.time = 1000ULL * i + x % 2500;
+  r.raw = (x>>8)%7==0 ? 0xFFFF : (uint16_t)archiveRandom();
+  r.MTreg = (x>>12)%97==0 ? (uint8_t)(x>>24) : BH1750_MTREG_MIN + (x>>16) % (BH1750_MTREG_MAX-BH1750_MTREG_MIN+1);
+  r.mode = modes[(x>>20) % sizeof(modes)];
+  r.status = i%16==5 ? BH1750_MEASUREMENT_ERROR : BH1750_MEASUREMENT_VALID;
+  if(r.raw==0xFFFF && (r.status&BH1750_MEASUREMENT_VALID)) {
+    r.status |= BH1750_MEASUREMENT_SATURATED;
+  }
+  return r;
+}
+
+static bool archiveAppend(BH1750ArchiveWriter& writer, const archive_record_t& r, uint32_t i) {
+  if(i%2==1 && (r.status&BH1750_MEASUREMENT_VALID)) {
+    bh1750_record_t record = { r.raw, r.MTreg, r.mode };
+    return writer.append(r.time, record);
+  }
+  bh1750_measurement_t m;
+  memset(&m, 0, sizeof(m));
+  m.raw = r.raw;
+  m.MTreg = r.MTreg;
+  m.mode = r.mode;
+  m.status = r.status;
+  return writer.append(r.time, m);
+}
+
+/**
+ * Segment indexes against the records. Returns the number of violations.
+ */
+static unsigned long checkIndexes(BH1750ArchiveReader& reader, const archive_record_t* records, uint32_t count) {
+  unsigned long violations = 0;
+  uint32_t segments = (count + BH1750_ARCHIVE_RECORDS - 1) / BH1750_ARCHIVE_RECORDS;
+  if(reader.count()!=count || reader.segments()!=segments) {
+    printf("archive        count %lu segments %u, expected %u and %u\n",
+      (unsigned long)reader.count(), reader.segments(), count, segments);
+    return 1;
+  }
+  for(uint32_t s=0; s<segments; s++) {
+    bh1750_archive_index_t e;
+    memset(&e, 0, sizeof(e));
+    uint32_t first = s * BH1750_ARCHIVE_RECORDS;
+    for(uint32_t i=first; i<count && i<first+BH1750_ARCHIVE_RECORDS; i++) {
+      const archive_record_t& r = records[i];
+      if(e.count==0 || r.time<e.timeMin) e.timeMin = r.time;
+      if(e.count==0 || r.time>e.timeMax) e.timeMax = r.time;
+      e.count++;
+      if(archiveValid(r)) {
+        float lux = bh1750Lux(r.raw, r.MTreg, r.mode);
+        bool firstValid = e.valid==0;
+        if(firstValid || lux<e.luxMin) e.luxMin = lux;
+        if(firstValid || lux>e.luxMax) e.luxMax = lux;
+        if(firstValid || r.raw<e.rawMin) e.rawMin = r.raw;
+        if(firstValid || r.raw>e.rawMax) e.rawMax = r.raw;
+        if(firstValid || r.MTreg<e.MTregMin) e.MTregMin = r.MTreg;
+        if(firstValid || r.MTreg>e.MTregMax) e.MTregMax = r.MTreg;
+        e.valid++;
+      }
+    }
+    const bh1750_archive_index_t* idx = reader.index(s);
+    if(idx->count!=e.count || idx->valid!=e.valid || idx->timeMin!=e.timeMin || idx->timeMax!=e.timeMax
+      || !sameFloat(idx->luxMin, e.luxMin) || !sameFloat(idx->luxMax, e.luxMax) || idx->rawMin!=e.rawMin
+      || idx->rawMax!=e.rawMax || idx->MTregMin!=e.MTregMin || idx->MTregMax!=e.MTregMax) {
+      printf("archive        index of segment %u differs from the records\n", s);
+      violations++;
+    }
+  }
+  return violations;
+}
+
+/**
+ * One query and one range against the scan. Returns the number of violations.
+ */
+static unsigned long checkWindow(BH1750ArchiveReader& reader, const archive_record_t* records, uint32_t count,
+  uint64_t from, uint64_t to, size_t size, uint64_t* time, float* lux) {
+  size_t n = reader.query(from, to, time, lux, size);
+  size_t expected = 0;
+  bool found = false;
+  float lo = 0;
+  float hi = 0;
+  bool same = true;
+  for(uint32_t i=0; i<count; i++) {
+    const archive_record_t& r = records[i];
+    if(r.time<from || r.time>to || !archiveValid(r)) {
+      continue;
+    }
+    float l = bh1750Lux(r.raw, r.MTreg, r.mode);
+    if(!found || l<lo) lo = l;
+    if(!found || l>hi) hi = l;
+    found = true;
+    if(expected<size) {
+      same = same && expected<n && time[expected]==r.time && sameFloat(lux[expected], l);
+      expected++;
+    }
+  }
+  unsigned long violations = 0;
+  if(n!=expected || !same) {
+    printf("archive        query %llu..%llu (size %lu): %lu records, expected %lu%s\n", (unsigned long long)from,
+      (unsigned long long)to, (unsigned long)size, (unsigned long)n, (unsigned long)expected, same ? "" : ", values differ");
+    violations++;
+  }
+  float rlo = 0;
+  float rhi = 0;
+  bool rfound = reader.range(from, to, &rlo, &rhi);
+  if(rfound!=found || (found && (!sameFloat(rlo, lo) || !sameFloat(rhi, hi)))) {
+    printf("archive        range %llu..%llu: %d %g..%g, expected %d %g..%g\n", (unsigned long long)from,
+      (unsigned long long)to, rfound, rlo, rhi, found, lo, hi);
+    violations++;
+  }
+  return violations;
+}
+
+/**
+ * Round trip, index, query and range. Returns the number of violations.
+ */
+static unsigned long roundTrip(void) {
+  archive_record_t* records = (archive_record_t*)malloc(ARCHIVE_RECORDS * sizeof(archive_record_t));
+  uint64_t* time = (uint64_t*)malloc(ARCHIVE_RECORDS * sizeof(uint64_t));
+  float* lux = (float*)malloc(ARCHIVE_RECORDS * sizeof(float));
+  if(!records || !time || !lux) {
+    printf("archive        out of memory\n");
+    return 1;
+  }
+  unsigned long violations = 0;
+  unlink(ARCHIVE_PATH);
+  BH1750ArchiveWriter writer;
+  // the second half is appended after reopening the archive
+  for(uint32_t i=0; i<ARCHIVE_RECORDS; i++) {
+    if((i==0 || i==ARCHIVE_RECORDS/2) && !writer.open(ARCHIVE_PATH, 7)) {
+      printf("archive        cannot open %s\n", ARCHIVE_PATH);
+      return 1;
+    }
+    records[i] = archiveRecord(i);
+    if(!archiveAppend(writer, records[i], i)) {
+      printf("archive        append %u failed\n", i);
+      return 1;
+    }
+    if(i==ARCHIVE_RECORDS/2-1) {
+      writer.close();
+    }
+  }
+  writer.close();
+  if(writer.open(ARCHIVE_PATH, 8)) {
+    printf("archive        opened with another sensor id\n");
+    violations++;
+  }
+
+  BH1750ArchiveReader reader;
+  if(!reader.open(ARCHIVE_PATH) || reader.sensor()!=7) {
+    printf("archive        cannot read %s\n", ARCHIVE_PATH);
+    return 1;
+  }
+  violations += checkIndexes(reader, records, ARCHIVE_RECORDS);
+  uint64_t end = 1000ULL * ARCHIVE_RECORDS + 2500;
+  violations += checkWindow(reader, records, ARCHIVE_RECORDS, 0, end, ARCHIVE_RECORDS, time, lux);
+  violations += checkWindow(reader, records, ARCHIVE_RECORDS, end+1, end+1000, ARCHIVE_RECORDS, time, lux);
+  for(uint16_t q=0; q<ARCHIVE_QUERIES; q++) {
+    uint64_t from = archiveRandom() % end;
+    // windows from a few records to several segments
+    uint64_t length = (uint64_t)archiveRandom() % (q%2 ? 100000ULL : 40000000ULL);
+    size_t size = q%5==0 ? 1 + archiveRandom() % 200 : ARCHIVE_RECORDS;
+    violations += checkWindow(reader, records, ARCHIVE_RECORDS, from, from+length, size, time, lux);
+  }
+  reader.close();
+  unlink(ARCHIVE_PATH);
+  printf("archive        round trip: %lu records in %u segments, %u queries, violations=%lu\n",
+    (unsigned long)ARCHIVE_RECORDS, (unsigned)((ARCHIVE_RECORDS + BH1750_ARCHIVE_RECORDS - 1) / BH1750_ARCHIVE_RECORDS),
+    ARCHIVE_QUERIES, violations);
+  free(records);
+  free(time);
+  free(lux);
+  return violations;
+}
+
+/**
+ * Record i of the concurrent writer: time i, light level derived from i.
+ */
+static bh1750_record_t concurrentRecord(uint32_t i) {
+  bh1750_record_t r = { (uint16_t)(i*7919), (uint8_t)(BH1750_MTREG_MIN + i%200), BH1750_ONE_TIME_HIGH_RES_MODE };
+  return r;
+}
+
+/**
+ * A writer process appends while the reader queries. Returns the number of violations.
+ */
+static unsigned long concurrent(void) {
+  unlink(ARCHIVE_PATH);
+  BH1750ArchiveWriter writer;
+  if(!writer.open(ARCHIVE_PATH, 9)) {
+    printf("archive        cannot open %s\n", ARCHIVE_PATH);
+    return 1;
+  }
+  writer.close();
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid==0) {
+    bool ok = writer.open(ARCHIVE_PATH, 9);
+    for(uint32_t i=0; ok && i<ARCHIVE_CONCURRENT_RECORDS; i++) {
+      // pauses let the reader run in between, also on a single CPU
+      if(i%1000==0) {
+        usleep(200);
+      }
+      ok = writer.append(i, concurrentRecord(i));
+    }
+    writer.close();
+    _exit(ok ? 0 : 1);
+  }
+
+  uint64_t* time = (uint64_t*)malloc(ARCHIVE_CONCURRENT_RECORDS * sizeof(uint64_t));
+  float* lux = (float*)malloc(ARCHIVE_CONCURRENT_RECORDS * sizeof(float));
+  BH1750ArchiveReader reader;
+  unsigned long violations = 0;
+  unsigned long queries = 0;
+  unsigned long partial = 0;
+  size_t last = 0;
+  bool done = false;
+  int status = 0;
+  if(pid<0 || !time || !lux || !reader.open(ARCHIVE_PATH)) {
+    printf("archive        cannot start the concurrent writer\n");
+    violations++;
+    done = true;
+  }
+  while(!done) {
+    // the writer has finished before the last query
+    done = waitpid(pid, &status, WNOHANG)==pid;
+    size_t n = reader.query(0, ARCHIVE_CONCURRENT_RECORDS, time, lux, ARCHIVE_CONCURRENT_RECORDS);
+    queries++;
+    bool prefix = n>=last;
+    for(size_t i=0; i<n && prefix; i++) {
+      bh1750_record_t r = concurrentRecord(i);
+      prefix = time[i]==i && sameFloat(lux[i], bh1750Lux(r.raw, r.MTreg, r.mode));
+    }
+    if(!prefix) {
+      printf("archive        concurrent query %lu: %lu records, not a complete prefix\n", queries, (unsigned long)n);
+      violations++;
+    }
+    if(n>0 && n<ARCHIVE_CONCURRENT_RECORDS) {
+      partial++;
+    }
+    last = n;
+  }
+  if(pid>0 && (!WIFEXITED(status) || WEXITSTATUS(status)!=0 || last!=ARCHIVE_CONCURRENT_RECORDS)) {
+    printf("archive        concurrent writer failed or records missing (%lu)\n", (unsigned long)last);
+    violations++;
+  }
+  if(pid>0 && partial==0) {
+    printf("archive        no query while the writer was appending\n");
+    violations++;
+  }
+  printf("archive        concurrent: %lu records, %lu queries (%lu during the writing), segments=%u, violations=%lu\n",
+    (unsigned long)ARCHIVE_CONCURRENT_RECORDS, queries, partial, reader.segments(), violations);
+  reader.close();
+  unlink(ARCHIVE_PATH);
+  free(time);
+  free(lux);
+  return violations;
+}
+
+int main(void) {
+  unsigned long violations = roundTrip() + concurrent();
+  archiveBenchmark(stdout, ARCHIVE_BENCH_PATH, ARCHIVE_BENCH_RECORDS);
+  unlink(ARCHIVE_BENCH_PATH);
+  return violations>0 ? 1 : 0;
+}
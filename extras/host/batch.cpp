@@ -0,0 +1,50 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include <string.h>
+#include "AS_BH1750Batch.h"
+
+/*
+ Batch conversion (AS_BH1750Batch.h): bit-exactness of the vector kernel and of convertBatch
+ with the scalar reference over all raw values, MTreg bytes and hardware modes
+ (batchExactCheck), then the throughput of each variant (batchBenchmark).
+ The optional argument names the kernel the build must use (avx2, neon or scalar),
+ so a build that silently falls back to the scalar path fails.
+ Exits with 1 on a violation.
+*/
+
+// records of the throughput benchmark
+#define BATCH_RECORDS 1000000
+
+int main(int argc, char** argv) {
+  if(argc>1 && strcmp(argv[1], convertBatchKernel())!=0) {
+    printf("batch          kernel %s, expected %s\n", convertBatchKernel(), argv[1]);
+    return 1;
+  }
+  unsigned long differing = batchExactCheck(stdout);
+  batchBenchmark(stdout, BATCH_RECORDS);
+  return differing>0 ? 1 : 0;
+}
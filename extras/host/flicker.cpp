@@ -0,0 +1,100 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Sim.h"
+#include "AS_BH1750.h"
+
+/*
+ Flicker-immune measurement times (setFlickerFrequency): 100 Hz and 120 Hz flicker of depth 0.5,
+ single measurements in H-, H2- and L-resolution at varying phases of the flicker.
+ With the matching flicker frequency, the spread (max - min) of the readings must stay within
+ one quantisation step of the mode plus FLICKER_SPREAD of the level; without it, the spread
+ is reported for comparison.
+ Exits with 1 on a violation.
+*/
+
+// number of readings per mode
+#define FLICKER_READINGS 32
+// max. spread of the readings beyond one quantisation step (fraction of the level)
+#define FLICKER_SPREAD 0.01
+
+static const bh1750_scene_t flickerScenes[] = {
+  // name           shape           level   level2   time      freq  depth
+  { "flicker_100hz",SCENE_FLICKER,  300,    0,       0,        100,  0.5 },
+  { "flicker_120hz",SCENE_FLICKER,  300,    0,       0,        120,  0.5 }
+};
+
+static const sensors_resolution_t flickerModes[] = { RESOLUTION_NORMAL, RESOLUTION_HIGH, RESOLUTION_LOW };
+static const char* const flickerModeNames[] = { "H", "H2", "L" };
+
+/**
+ * Spread of FLICKER_READINGS one-time measurements, each after a pause of 1..17 ms
+ * (varying phase). Returns false on a violation.
+ */
+static bool run(const bh1750_scene_t* scene, uint8_t m, bool immune) {
+  AS_BH1750 sensor;
+  BH1750Sim.reset(scene);
+  sensor.begin(flickerModes[m], true);
+  sensor.setFlickerFrequency(immune ? scene->frequency : 0);
+
+  float min = 1e9;
+  float max = -1;
+  bool ok = true;
+  for(uint8_t i=0; i<FLICKER_READINGS; i++) {
+    simDelay(1 + (i*7)%17);
+    float lux = sensor.readLightLevel(&simDelay);
+    ok = ok && lux>=0;
+    if(lux<min) {
+      min = lux;
+    }
+    if(lux>max) {
+      max = lux;
+    }
+  }
+  // one quantisation step: 1 count (H), 0.5 count (H2), 4 counts (L) at the MTreg in use
+  bh1750_state_t state;
+  sensor.saveState(&state);
+  uint8_t mtreg = state.MTreg;
+  float step = flickerModes[m]==RESOLUTION_LOW ? 4 : (flickerModes[m]==RESOLUTION_HIGH ? 0.5 : 1);
+  float bound = step / 1.2 * BH1750_MTREG_DEFAULT / mtreg + scene->level*FLICKER_SPREAD;
+
+  bool valid = !immune || (ok && max-min <= bound);
+  printf("%-13s %-2s flicker %-3u MTreg=%3u spread=%7.3f lx (bound %.3f) %s\n",
+    scene->name, flickerModeNames[m], sensor.getFlickerFrequency(), mtreg, max-min, bound,
+    valid ? (immune ? "ok" : "") : "VIOLATION");
+  return valid;
+}
+
+int main(void) {
+  bool ok = true;
+  for(uint8_t s=0; s<sizeof(flickerScenes)/sizeof(flickerScenes[0]); s++) {
+    for(uint8_t m=0; m<sizeof(flickerModes)/sizeof(flickerModes[0]); m++) {
+      run(&flickerScenes[s], m, false);
+      ok = run(&flickerScenes[s], m, true) && ok;
+    }
+  }
+  return ok ? 0 : 1;
+}
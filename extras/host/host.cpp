@@ -0,0 +1,93 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "AS_BH1750Sim.h"
+
+/*
+ Arduino core functions of the host builds on the virtual clock of the simulated sensor.
+*/
+
+HostSerial Serial;
+TwoWire Wire;
+
+unsigned long millis(void) {
+  return BH1750Sim.millis();
+}
+
+unsigned long micros(void) {
+  return BH1750Sim.micros();
+}
+
+void delay(unsigned long ms) {
+  BH1750Sim.delay(ms);
+}
+
+void delayMicroseconds(unsigned int us) {
+  BH1750Sim.advance(us);
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t, uint8_t) {
+}
+
+int digitalRead(uint8_t) {
+  return HIGH; // released bus lines
+}
+
+// Unused bus (the drivers use BH1750Sim): no device responds
+void TwoWire::begin(void) {
+}
+
+void TwoWire::beginTransmission(int) {
+}
+
+size_t TwoWire::write(uint8_t) {
+  return 0;
+}
+
+uint8_t TwoWire::endTransmission(void) {
+  return 2; // NACK on address
+}
+
+uint8_t TwoWire::requestFrom(uint8_t, uint8_t) {
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(int, int) {
+  return 0;
+}
+
+int TwoWire::available(void) {
+  return 0;
+}
+
+int TwoWire::read(void) {
+  return -1;
+}
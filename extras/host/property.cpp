@@ -0,0 +1,51 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Sim.h"
+
+/*
+ Property check of the measurement stage machine (simPropertyRun).
+ Standalone: property [runs] [seed], exits with 1 if an invariant is violated.
+ With BH1750_FUZZER defined, the libFuzzer entry point is built instead of main().
+*/
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  bh1750_sim_property_t r;
+  memset(&r, 0, sizeof(r));
+  simPropertyRun(data, size, &r, stderr);
+  if(r.nonTerminating+r.busOverrun+r.inconsistent+r.spurious>0) {
+    abort();
+  }
+  return 0;
+}
+
+#ifndef BH1750_FUZZER
+int main(int argc, char** argv) {
+  unsigned long runs = argc>1 ? strtoul(argv[1], NULL, 10) : 100000;
+  uint32_t seed = argc>2 ? strtoul(argv[2], NULL, 10) : 1;
+  return simPropertyCheck(stdout, seed, runs)>0 ? 1 : 0;
+}
+#endif
@@ -0,0 +1,102 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "Arduino.h"
+#include "Wire.h"
+
+/*
+ Arduino functions for the size comparison (size_fixed, size_core): out of line and
+ with side effects on volatile registers, so that neither build can fold them away.
+ Both programs link the same stubs, the difference of their text size is the driver.
+*/
+
+static volatile unsigned long clockRegister;
+static volatile uint8_t busRegister;
+
+HostSerial Serial;
+TwoWire Wire;
+
+unsigned long millis(void) {
+  return clockRegister/1000;
+}
+
+unsigned long micros(void) {
+  return clockRegister;
+}
+
+void delay(unsigned long ms) {
+  clockRegister += ms*1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  clockRegister += us;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  busRegister = pin^mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  busRegister = pin^value;
+}
+
+int digitalRead(uint8_t) {
+  return busRegister&1;
+}
+
+void TwoWire::begin(void) {
+  busRegister = 0;
+}
+
+void TwoWire::beginTransmission(int address) {
+  busRegister = address;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  busRegister = data;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(void) {
+  return busRegister&0x80;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+  return requestFrom((int)address, (int)quantity);
+}
+
+uint8_t TwoWire::requestFrom(int address, int quantity) {
+  busRegister = address;
+  return quantity;
+}
+
+int TwoWire::available(void) {
+  return busRegister&1;
+}
+
+int TwoWire::read(void) {
+  return busRegister;
+}
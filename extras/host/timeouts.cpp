@@ -0,0 +1,86 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "AS_BH1750Sim.h"
+#include "AS_BH1750A.h"
+
+/*
+ Bounded bus transactions (setBusTimeout): on a stuck bus, no call blocks longer than one
+ timeout and the results follow the circuit breaker (simStuckBusBenchmark). Two sensors with
+ interleaved asynchronous measurements: a timeout of one sensor must not turn an ordinary
+ bus error of the other into BH1750_TIMEOUT.
+ Exits with 1 on a violation.
+*/
+
+static uint8_t status(AS_BH1750A& sensor) {
+  bh1750_measurement_t m;
+  sensor.readMeasurementAsync(&m);
+  return m.status;
+}
+
+/**
+ * Sensor a starts, sensor b times out (stretched clock), then the reading of a is not acknowledged.
+ */
+static bool isolated(void) {
+  AS_BH1750A a;
+  AS_BH1750A b;
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  AS_BH1750A::setFailureThreshold(0);
+  a.begin(RESOLUTION_NORMAL, true);
+  b.begin(RESOLUTION_NORMAL, true);
+  a.startMeasurementAsync(&simMillis);
+
+  bh1750_sim_fault_step_t stretch = { BH1750Sim.transactions(), 1, SIM_FAULT_CLOCK_STRETCH, 50000 };
+  BH1750Sim.setFaults(&stretch, 1);
+  b.startMeasurementAsync(&simMillis);
+  while(!b.isMeasurementReady()) {
+    simDelay(1);
+  }
+
+  simDelay(a.nextDelay());
+  bh1750_sim_fault_step_t nack = { BH1750Sim.transactions(), 2, SIM_FAULT_NACK_ADDRESS, 0 };
+  BH1750Sim.setFaults(&nack, 1);
+  while(!a.isMeasurementReady()) {
+    simDelay(1);
+  }
+  BH1750Sim.setFaults(NULL, 0);
+  AS_BH1750A::setFailureThreshold(BH1750_BREAKER_THRESHOLD);
+
+  uint8_t sa = status(a);
+  uint8_t sb = status(b);
+  bool ok = sa==BH1750_MEASUREMENT_ERROR && sb==BH1750_MEASUREMENT_TIMEOUT;
+  printf("interleaved    sensor a: %s, sensor b: %s%s\n",
+    sa==BH1750_MEASUREMENT_ERROR ? "error" : sa==BH1750_MEASUREMENT_TIMEOUT ? "timeout" : "other",
+    sb==BH1750_MEASUREMENT_ERROR ? "error" : sb==BH1750_MEASUREMENT_TIMEOUT ? "timeout" : "other",
+    ok ? "" : " VIOLATION");
+  return ok;
+}
+
+int main(void) {
+  bool ok = simStuckBusBenchmark(stdout, BH1750_BUS_TIMEOUT)==0;
+  ok = isolated() && ok;
+  return ok ? 0 : 1;
+}
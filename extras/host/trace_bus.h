@@ -0,0 +1,61 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#ifndef trace_bus_h
+#define trace_bus_h
+
+#include "AS_BH1750Sim.h"
+#include "AS_BH1750Trace.h"
+
+/*
+ Bus of the trace round trip check (BH1750_WIRE = traceBus): records the
+ transactions of the driver on the simulated sensor or replays a trace.
+*/
+
+class TraceBus {
+public:
+  BH1750TraceRecorder<BH1750SimDevice>* recorder;
+  BH1750TraceReplay* replay; // replaying if not NULL
+
+  void begin(void) { replay!=NULL ? replay->begin() : recorder->begin(); }
+  void beginTransmission(int address) { replay!=NULL ? replay->beginTransmission(address) : recorder->beginTransmission(address); }
+  size_t write(uint8_t data) { return replay!=NULL ? replay->write(data) : recorder->write(data); }
+  uint8_t endTransmission(void) { return replay!=NULL ? replay->endTransmission() : recorder->endTransmission(); }
+  uint8_t requestFrom(int address, int quantity) { return replay!=NULL ? replay->requestFrom(address, quantity) : recorder->requestFrom(address, quantity); }
+  int available(void) { return replay!=NULL ? replay->available() : recorder->available(); }
+  int read(void) { return replay!=NULL ? replay->read() : recorder->read(); }
+
+  // Timeout interface (not part of the trace)
+  void setWireTimeout(uint32_t timeout, bool reset) { if(replay==NULL) BH1750Sim.setWireTimeout(timeout, reset); }
+  bool getWireTimeoutFlag(void) { return replay==NULL && BH1750Sim.getWireTimeoutFlag(); }
+  void clearWireTimeoutFlag(void) { if(replay==NULL) BH1750Sim.clearWireTimeoutFlag(); }
+
+  unsigned long clock(void) { return replay!=NULL ? replay->clock() : recorder->clock(&simMillis); }
+};
+
+extern TraceBus traceBus;
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ This is a (Arduino) library for the BH1750FVI Digital Light Sensor.
+ 
+ Description:
+ http://www.rohm.com/web/global/products/-/product/BH1750FVI
+ 
+ Datasheet:
+ http://rohmfs.rohm.com/en/products/databook/datasheet/ic/sensor/light/bh1750fvi-e.pdf
+ 
+ Copyright (c) 2013 Alexander Schulz.  All right reserved.
+ 
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation; either
+ version 2.1 of the License, or (at your option) any later version.
+ 
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, write to the Free Software
+ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA	 02110-1301	 USA
+ */
+
+#include "trace_bus.h"
+#include "AS_BH1750.h"
+
+/*
+ Round trip of trace record and replay (AS_BH1750Trace.h): the driver is recorded on the
+ simulated sensor, the trace is saved, loaded and played back to the unmodified driver,
+ which must deliver the recorded light levels without mismatches. A replay that leaves
+ out recorded calls (isPresent in continuous mode: wake-up and one reading) must
+ resynchronise and deliver the same light levels. requestFrom is recorded with its
+ address, a read without data (-1) is replayed as -1, and a request to another
+ address is a mismatch.
+ Exits with 1 on a difference.
+*/
+
+#define ROUNDTRIP_EVENTS 1024
+#define ROUNDTRIP_READINGS 8
+
+TraceBus traceBus;
+
+static unsigned long tracedMillis(void) {
+  return traceBus.clock();
+}
+
+/**
+ * Sequence of the driver: begin, readings in the automatic and a fixed mode,
+ * one measurement record with clock queries, optionally isPresent() in continuous mode.
+ */
+static void runSequence(float* lux, bool withPresenceCheck) {
+  AS_BH1750 sensor;
+  sensor.begin(RESOLUTION_AUTO_HIGH, true);
+  for(uint8_t i=0; i<ROUNDTRIP_READINGS; i++) {
+    if(i==ROUNDTRIP_READINGS/2) {
+      sensor.begin(RESOLUTION_NORMAL, false);
+    }
+    if(i==ROUNDTRIP_READINGS/2+1 && withPresenceCheck) {
+      sensor.isPresent();
+    }
+    if(i==ROUNDTRIP_READINGS-1) {
+      bh1750_measurement_t m;
+      sensor.readMeasurement(&m, &delay, &tracedMillis);
+      lux[i] = m.lux;
+    } else {
+      lux[i] = sensor.readLightLevel();
+    }
+    delay(300);
+  }
+}
+
+static bool replay(const char* name, bh1750_trace_event_t* events, uint16_t count, const float* recorded, bool withPresenceCheck) {
+  BH1750TraceReplay player(events, count);
+  float lux[ROUNDTRIP_READINGS];
+  traceBus.replay = &player;
+  runSequence(lux, withPresenceCheck);
+  traceBus.replay = NULL;
+  bool same = true;
+  for(uint8_t i=0; i<ROUNDTRIP_READINGS; i++) {
+    same = same && lux[i]==recorded[i];
+  }
+  printf("%-14s transactions=%u mismatches=%u finished=%d levels=%s\n",
+    name, player.transactions(), player.mismatches(), player.finished(), same ? "same" : "different");
+  return same && player.finished();
+}
+
+/**
+ * Request of two bytes and three reads on the bus directly, recorded and replayed.
+ */
+static bool noData(void) {
+  bh1750_trace_event_t events[4];
+  BH1750TraceRecorder<BH1750SimDevice> recorder(BH1750Sim, events, 4, &simMicros);
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  recorder.requestFrom(BH1750_DEFAULT_I2CADDR, 2);
+  int recorded[3];
+  for(uint8_t i=0; i<3; i++) {
+    recorded[i] = recorder.read();
+  }
+
+  BH1750TraceReplay player(events, recorder.count());
+  bool ok = player.requestFrom(BH1750_DEFAULT_I2CADDR, 2)==events[0].result;
+  for(uint8_t i=0; i<3; i++) {
+    ok = ok && player.read()==recorded[i];
+  }
+  ok = ok && player.mismatches()==0 && recorded[2]==-1 && events[0].detail==BH1750_DEFAULT_I2CADDR;
+  player.rewind();
+  player.requestFrom(BH1750_SECOND_I2CADDR, 2);
+  ok = ok && player.mismatches()==1;
+  printf("no data        address=0x%02X reads=%d,%d,%d replayed=%s\n",
+    events[0].detail, recorded[0], recorded[1], recorded[2], ok ? "same" : "different");
+  return ok;
+}
+
+int main(void) {
+  static bh1750_trace_event_t events[ROUNDTRIP_EVENTS];
+  static bh1750_trace_event_t loaded[ROUNDTRIP_EVENTS];
+  BH1750TraceRecorder<BH1750SimDevice> recorder(BH1750Sim, events, ROUNDTRIP_EVENTS, &simMicros);
+  float recorded[ROUNDTRIP_READINGS];
+
+  BH1750Sim.reset(&BH1750_SCENES[0]);
+  traceBus.recorder = &recorder;
+  traceBus.replay = NULL;
+  runSequence(recorded, true);
+  printf("recorded       events=%u overflow=%d levels=", recorder.count(), recorder.overflow());
+  for(uint8_t i=0; i<ROUNDTRIP_READINGS; i++) {
+    printf("%s%.1f", i>0 ? "," : "", recorded[i]);
+  }
+  printf("\n");
+
+  // trace file
+  FILE* file = tmpfile();
+  bool saved = file!=NULL && saveTrace(file, events, recorder.count());
+  uint16_t count = 0;
+  if(saved) {
+    rewind(file);
+    count = loadTrace(file, loaded, ROUNDTRIP_EVENTS);
+    fclose(file);
+  }
+  bool ok = !recorder.overflow() && count==recorder.count() && memcmp(events, loaded, count*sizeof(loaded[0]))==0;
+  printf("trace file     saved=%d loaded=%u identical=%d\n", saved, count, ok);
+
+  for(uint16_t i=0; i<count; i++) {
+    ok = ok && (loaded[i].type!=BH1750_TRACE_REQUEST || loaded[i].detail==BH1750_DEFAULT_I2CADDR);
+  }
+  ok = replay("replay", loaded, count, recorded, true) && ok;
+  ok = replay("replay_resync", loaded, count, recorded, false) && ok;
+  ok = noData() && ok;
+  return ok ? 0 : 1;
+}